@@ -0,0 +1,125 @@
+// File: async_logger.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/async_logger.hpp"
+#include "include/trace.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <iostream>
+
+void perror_and_exit(const char *header);
+
+// How long the background thread sleeps at most while there is nothing to do
+static const std::chrono::milliseconds IDLE_TIMEOUT(100);
+
+// AsyncLogger Public API Functions ----------------------------------------------------------------
+
+AsyncLogger::AsyncLogger(std::string path, LoggerOptions options) :
+    options_(options),
+    file_desc_(::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)),
+    queue_(options.queue_capacity),
+    last_sync_(std::chrono::steady_clock::now()),
+    unsynced_(false),
+    stopping_(false),
+    sleeping_(false) {
+    if (file_desc_ < 0) perror_and_exit("open() failed");
+    worker_ = std::thread(&AsyncLogger::run_, this);
+}
+
+AsyncLogger::~AsyncLogger() {
+    {
+        std::lock_guard<std::mutex> lock(idle_lock_);
+        stopping_ = true;
+    }
+    idle_cv_.notify_one();
+    worker_.join();
+
+    close(file_desc_);
+}
+
+void AsyncLogger::log(std::string line) {
+    // A full queue means the disk cannot keep up, so wait for room rather than drop the line
+    while (!queue_.try_push(std::move(line))) {
+        idle_cv_.notify_one();
+        std::this_thread::yield();
+    }
+
+    if (sleeping_) {
+        std::lock_guard<std::mutex> lock(idle_lock_);
+        idle_cv_.notify_one();
+    }
+}
+
+// AsyncLogger Private API Functions ---------------------------------------------------------------
+
+void AsyncLogger::run_() {
+    std::string pending;
+    std::string line;
+    std::chrono::steady_clock::time_point oldest;
+
+    while (true) {
+        // Gather every line that queued up since the last write, up to one batch
+        while (pending.size() < options_.batch_bytes && queue_.try_pop(line)) {
+            if (pending.empty()) oldest = std::chrono::steady_clock::now();
+            pending += line;
+        }
+
+        auto now      = std::chrono::steady_clock::now();
+        bool stopping = stopping_;
+        bool due      = pending.size() >= options_.batch_bytes || stopping
+                   || now - oldest >= options_.flush_interval;
+        if (!pending.empty() && due) {
+            write_(pending);
+            continue;
+        }
+        if (stopping && queue_.empty()) break;
+
+        if (options_.sync == LogSync::PERIODIC && unsynced_
+            && now - last_sync_ >= options_.sync_interval) {
+            sync_();
+        }
+
+        // Sleep until a line is queued, the pending lines are due or a periodic sync is due
+        auto wake_at = now + IDLE_TIMEOUT;
+        if (!pending.empty()) wake_at = std::min(wake_at, oldest + options_.flush_interval);
+        if (options_.sync == LogSync::PERIODIC && unsynced_) {
+            wake_at = std::min(wake_at, last_sync_ + options_.sync_interval);
+        }
+
+        std::unique_lock<std::mutex> lock(idle_lock_);
+        sleeping_ = true;
+        idle_cv_.wait_until(lock, wake_at, [this] { return !queue_.empty() || stopping_; });
+        sleeping_ = false;
+    }
+
+    if (options_.sync != LogSync::NONE && unsynced_) sync_();
+}
+
+void AsyncLogger::write_(std::string &pending) {
+    TRACE_SPAN("logger.write");
+    if (options_.echo) std::cout << pending << std::flush;
+
+    size_t total_written = 0;
+    while (total_written < pending.size()) {
+        ssize_t bytes_written =
+            write(file_desc_, pending.data() + total_written, pending.size() - total_written);
+        if (bytes_written < 0 && errno == EINTR) continue;
+        if (bytes_written < 0) perror_and_exit("write() failed");
+        total_written += bytes_written;
+    }
+    pending.clear();
+    unsynced_ = true;
+
+    if (options_.sync == LogSync::EVERY_WRITE) sync_();
+}
+
+void AsyncLogger::sync_() {
+    TRACE_SPAN("logger.sync");
+    if (fdatasync(file_desc_) < 0) perror_and_exit("fdatasync() failed");
+
+    last_sync_ = std::chrono::steady_clock::now();
+    unsynced_  = false;
+}
@@ -0,0 +1,419 @@
+// File: benchmark.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/benchmark.hpp"
+#include "include/compression.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+
+// The number of multicast messages sent between checks of the send schedule
+static const size_t SEND_BURST = 16;
+
+// How long deliveries must stop arriving for before the benchmark considers them finished
+static const std::chrono::milliseconds SETTLE_TIME(500);
+
+// The longest the benchmark waits for deliveries to finish once the load stops
+static const std::chrono::seconds SETTLE_LIMIT(10);
+
+// Benchmark Public API Functions ------------------------------------------------------------------
+
+Benchmark::Benchmark(BenchmarkOptions options) :
+    options_(options),
+    coordinator_process_(-1),
+    coordinator_config_(std::to_string(options.coordinator_port) + "_bench_coordinator.conf"),
+    next_delivery_token_(options.participants),
+    last_sent_(0),
+    acknowledged_(0),
+    disconnects_(0),
+    last_delivery_(0),
+    sending_(false),
+    receiving_(false) {}
+
+Benchmark::~Benchmark() { stop_coordinator_(); }
+
+bool Benchmark::run() {
+    if (!start_coordinator_()) {
+        std::cerr << "Could not start the coordinator at " << options_.coordinator_path << "\n";
+        return false;
+    }
+
+    // Every participant listens before it registers, like `myparticipant` does
+    for (size_t i = 0; i < options_.participants; i++) {
+        std::unique_ptr<Member> member = std::make_unique<Member>();
+        member->pid                     = i + 1;
+        member->port                    = options_.coordinator_port + 1 + i;
+        member->listener.do_bind(member->port);
+        member->listener.do_listen(16);
+        member->listener.do_set_nonblocking();
+        event_loop_.do_add(member->listener, i);
+        members_.push_back(std::move(member));
+    }
+
+    receiving_ = true;
+    std::thread receiver(&Benchmark::receive_, this);
+
+    for (std::unique_ptr<Member> &member : members_) {
+        member->connected = request_(MulticastMessageType::PARTICIPANT_REGISTER, member->pid,
+                                     std::to_string(member->port));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    sending_   = true;
+    std::thread churner(&Benchmark::churn_, this);
+    send_load_();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    sending_                              = false;
+    churner.join();
+
+    // Wait for the last deliveries and replays to arrive
+    auto settle_start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - settle_start < SETTLE_LIMIT) {
+        std::this_thread::sleep_for(SETTLE_TIME / 5);
+        if (now_() - last_delivery_ > std::chrono::nanoseconds(SETTLE_TIME).count()) break;
+    }
+
+    receiving_ = false;
+    event_loop_.do_wake();
+    receiver.join();
+
+    report_(elapsed.count());
+    stop_coordinator_();
+
+    return true;
+}
+
+// Benchmark Private API Functions -----------------------------------------------------------------
+
+bool Benchmark::start_coordinator_() {
+    // Every run starts from a cold coordinator, not from the checkpoint an earlier run left behind
+    std::filesystem::remove_all(std::to_string(options_.coordinator_port) + "_message_log");
+
+    // The persistence time is long enough that every missed message is replayed
+    std::ofstream config(coordinator_config_);
+    config << options_.coordinator_port << "\n" << 3600 << "\n\n\n\n" << options_.coordinator_shards
+           << "\n" << options_.compression_threshold << "\n";
+    config.close();
+
+    coordinator_process_ = fork();
+    if (coordinator_process_ < 0) return false;
+    if (coordinator_process_ == 0) {
+        // The coordinator prints every message, which would only slow it down here
+        int null_fd = ::open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execl(options_.coordinator_path.c_str(), options_.coordinator_path.c_str(),
+              coordinator_config_.c_str(), (char *)nullptr);
+        _exit(EXIT_FAILURE);
+    }
+
+    std::string port_str    = std::to_string(options_.coordinator_port);
+    InternetAddress address = InternetAddress::from_ip_address("127.0.0.1", port_str.c_str());
+    for (int attempt = 0; attempt < 50; attempt++) {
+        InternetSocket probe;
+        if (probe.try_connect(address)) return true;
+        if (waitpid(coordinator_process_, nullptr, WNOHANG) != 0) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    coordinator_process_ = -1;
+    return false;
+}
+
+void Benchmark::stop_coordinator_() {
+    if (coordinator_process_ > 0) {
+        kill(coordinator_process_, SIGTERM);
+        waitpid(coordinator_process_, nullptr, 0);
+        coordinator_process_ = -1;
+    }
+    std::remove(coordinator_config_.c_str());
+}
+
+bool Benchmark::request_(MulticastMessageType type, uint16_t pid, std::string body) {
+    MulticastMessage request(type, pid, std::time(0));
+    request << body;
+    if (type == MulticastMessageType::PARTICIPANT_REGISTER && options_.compression_threshold > 0) {
+        request.set_compressed();
+    }
+
+    InternetSocket socket;
+    socket.do_connect("127.0.0.1", options_.coordinator_port);
+    socket.do_sendv(request.to_buffers());
+
+    FrameReader reply_reader(MulticastMessageHeader::MAX_SIZE);
+    MulticastMessageHeader header;
+    Buffer reply_body(nullptr, 0);
+    if (!reply_reader.read(socket, header, reply_body)) return false;
+
+    return header.type == MulticastMessageType::ACKNOWLEDGEMENT;
+}
+
+void Benchmark::send_load_() {
+    InternetSocket socket;
+    socket.do_connect("127.0.0.1", options_.coordinator_port);
+    std::thread ack_drainer(&Benchmark::drain_acks_, this, std::ref(socket));
+
+    auto start    = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(options_.duration_seconds);
+    auto interval =
+        std::chrono::duration<double>(1.0 / std::max<size_t>(options_.msends_per_second, 1));
+
+    uint64_t sequence = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+        // Send whatever the schedule says is due, in small bursts so that falling behind is
+        // caught up on rather than lost
+        for (size_t i = 0; i < SEND_BURST; i++) {
+            auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   interval * sequence);
+            if (due > std::chrono::steady_clock::now()) break;
+
+            sequence++;
+            std::string body = std::to_string(sequence) + " " + std::to_string(now_()) + " ";
+            if (body.size() < options_.message_size) body.resize(options_.message_size, 'x');
+
+            MulticastMessage msend(MulticastMessageType::PARTICIPANT_MSEND, 1, std::time(0));
+            msend << body;
+            if (options_.compression_threshold > 0) msend.compress(options_.compression_threshold);
+            socket.do_sendv(msend.to_buffers());
+            last_sent_ = sequence;
+        }
+
+        auto next_due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                    interval * sequence);
+        std::this_thread::sleep_until(std::min(next_due, deadline));
+    }
+
+    sending_ = false;
+    ack_drainer.join();
+}
+
+void Benchmark::drain_acks_(InternetSocket &socket) {
+    PollInfo readable_request;
+    readable_request.readable  = true;
+    readable_request.writeable = false;
+
+    FrameReader ack_reader;
+    while (sending_ || acknowledged_ < last_sent_) {
+        // Poll so that the end of the load is noticed even when no acknowledgement is on its way
+        PollInfo result = socket.do_poll(readable_request, 100);
+        if (!result.valid) return;
+        if (!result.readable) continue;
+        if (!ack_reader.fill(socket)) return;
+
+        MulticastMessageHeader header;
+        Buffer body(nullptr, 0);
+        while (ack_reader.next(header, body)) {
+            if (header.type == MulticastMessageType::ACKNOWLEDGEMENT) acknowledged_++;
+        }
+    }
+}
+
+void Benchmark::churn_() {
+    std::mt19937 random(4780);
+    std::vector<std::pair<size_t, std::chrono::steady_clock::time_point>> away;
+
+    auto reconnect = [this](size_t index) {
+        Member &member        = *members_[index];
+        member.missed_through = last_sent_.load();
+        member.reconnected_at = now_();
+        member.connected      = request_(MulticastMessageType::PARTICIPANT_RECONNECT, member.pid,
+                                         std::to_string(member.port));
+    };
+
+    while (sending_ && options_.disconnects_per_second > 0) {
+        std::exponential_distribution<double> gap(options_.disconnects_per_second);
+        std::this_thread::sleep_for(std::chrono::duration<double>(gap(random)));
+
+        // Bring back everyone whose time away is up
+        auto now = std::chrono::steady_clock::now();
+        for (auto entry = away.begin(); entry != away.end();) {
+            if (entry->second > now) {
+                entry++;
+                continue;
+            }
+            reconnect(entry->first);
+            entry = away.erase(entry);
+        }
+
+        size_t index   = std::uniform_int_distribution<size_t>(0, members_.size() - 1)(random);
+        Member &member = *members_[index];
+        if (!sending_ || !member.connected) continue;
+
+        member.missed_from = last_sent_.load() + 1;
+        if (!request_(MulticastMessageType::PARTICIPANT_DISCONNECT, member.pid, "")) continue;
+        member.connected = false;
+        disconnects_++;
+
+        // Stay away for long enough to miss a few messages
+        std::uniform_int_distribution<int> time_away(100, 1000);
+        away.push_back({index, now + std::chrono::milliseconds(time_away(random))});
+    }
+
+    for (auto &[index, until] : away) reconnect(index);
+}
+
+void Benchmark::receive_() {
+    std::vector<LoopEvent> events;
+
+    while (receiving_) {
+        event_loop_.do_wait(events, 100);
+
+        for (LoopEvent &event : events) {
+            // A listener token means the coordinator is connecting to that participant
+            if (event.token < members_.size()) {
+                Member &member = *members_[event.token];
+                while (true) {
+                    InternetSocket socket = member.listener.try_accept();
+                    if (!socket.is_valid()) break;
+
+                    std::unique_ptr<Delivery> delivery = std::make_unique<Delivery>();
+                    delivery->member                   = event.token;
+                    delivery->socket                   = std::move(socket);
+
+                    // A connection made after a reconnect starts with the messages that were missed
+                    uint64_t missed_through = member.missed_through.exchange(0);
+                    if (missed_through >= member.missed_from) delivery->replay_through = missed_through;
+
+                    uint64_t token = next_delivery_token_++;
+                    event_loop_.do_add(delivery->socket, token);
+                    deliveries_.insert({token, std::move(delivery)});
+                }
+                continue;
+            }
+
+            auto entry = deliveries_.find(event.token);
+            if (entry == deliveries_.end()) continue;
+            if (!read_delivery_(*entry->second)) {
+                event_loop_.do_remove(entry->second->socket);
+                deliveries_.erase(entry);
+            }
+        }
+    }
+}
+
+bool Benchmark::read_delivery_(Delivery &delivery) {
+    // Notifications are edge-triggered, so keep receiving until the socket would block
+    while (true) {
+        TransferInfo result = delivery.reader.try_fill(delivery.socket);
+
+        // Compressed bodies are decompressed first, just like a participant would
+        auto record = [&](const MulticastMessageHeader &header, const char *body, size_t size) {
+            size_t frame_size = header.encoded_size() + size;
+            if (!(header.flags & HEADER_FLAG_COMPRESSED)) {
+                record_message_(delivery, body, size, frame_size);
+                return;
+            }
+
+            std::string decompressed;
+            if (decompress_payload(body, size, decompressed)) {
+                record_message_(delivery, decompressed.data(), decompressed.size(), frame_size);
+            }
+        };
+
+        MulticastMessageHeader header;
+        Buffer body(nullptr, 0);
+        while (delivery.reader.next(header, body)) {
+            if (header.type == MulticastMessageType::MULTI_MESSAGE_BATCH) {
+                MulticastBatch::unpack(body, [&](const char *frame, size_t size) {
+                    MulticastMessageHeader entry_header;
+                    size_t header_size =
+                        MulticastMessageHeader::decode((const unsigned char *)frame, size, entry_header);
+                    if (header_size == 0) return;
+                    record(entry_header, frame + header_size, size - header_size);
+                });
+            } else if (header.type == MulticastMessageType::MULTI_MESSAGE) {
+                record(header, (const char *)body.data(), body.size());
+            }
+        }
+
+        if (result.closed) return false;
+        if (result.would_block) return true;
+    }
+}
+
+void Benchmark::record_message_(Delivery &delivery, const char *body, size_t size,
+                                size_t frame_size) {
+    int64_t arrived = now_();
+    last_delivery_  = arrived;
+
+    // The body starts with the sequence number and send time of the message
+    char prefix[64] = {0};
+    std::memcpy(prefix, body, std::min(size, sizeof(prefix) - 1));
+
+    char *rest        = nullptr;
+    uint64_t sequence = std::strtoull(prefix, &rest, 10);
+    int64_t sent      = std::strtoll(rest, nullptr, 10);
+
+    if (delivery.replay_through > 0) {
+        delivery.replayed_messages++;
+        delivery.replayed_bytes += frame_size;
+        if (sequence < delivery.replay_through) return;
+
+        Member &member = *members_[delivery.member];
+        replays_.push_back(Replay {delivery.replayed_messages, delivery.replayed_bytes,
+                                   (arrived - member.reconnected_at) / 1e9});
+        delivery.replay_through = 0;
+        return;
+    }
+
+    latencies_.push_back(arrived - sent);
+}
+
+void Benchmark::report_(double seconds) {
+    uint64_t sent = last_sent_;
+
+    std::cout << "[Benchmark] " << options_.participants << " participants, "
+              << options_.msends_per_second << " msends/s of " << options_.message_size
+              << " bytes for " << options_.duration_seconds << " s, "
+              << options_.disconnects_per_second << " disconnects/s, "
+              << options_.coordinator_shards << " coordinator shards, compressing bodies of "
+              << options_.compression_threshold << "+ bytes\n";
+    std::cout << "[Benchmark] msend throughput: " << sent / seconds << " msends/s (" << sent
+              << " sent, " << acknowledged_ << " acknowledged)\n";
+    std::cout << "[Benchmark] live deliveries: " << latencies_.size() << " ("
+              << latencies_.size() / seconds << " /s)\n";
+
+    if (!latencies_.empty()) {
+        std::sort(latencies_.begin(), latencies_.end());
+        auto percentile = [this](double p) {
+            return latencies_[(size_t)(p * (latencies_.size() - 1))] / 1000.0;
+        };
+        std::cout << "[Benchmark] fan-out latency: p50 " << percentile(0.50) << " us, p99 "
+                  << percentile(0.99) << " us, p999 " << percentile(0.999) << " us\n";
+    }
+
+    size_t replayed_messages = 0, replayed_bytes = 0;
+    double replay_seconds = 0;
+    for (Replay &replay : replays_) {
+        replayed_messages += replay.messages;
+        replayed_bytes += replay.bytes;
+        replay_seconds += replay.seconds;
+    }
+
+    std::cout << "[Benchmark] replays: " << replays_.size() << " of " << disconnects_
+              << " disconnects, " << replayed_messages << " messages";
+    if (replay_seconds > 0) {
+        std::cout << " at " << replayed_messages / replay_seconds << " msgs/s ("
+                  << replayed_bytes / (1024.0 * 1024.0) / replay_seconds << " MB/s)";
+    }
+    std::cout << "\n";
+}
+
+int64_t Benchmark::now_() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
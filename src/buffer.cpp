@@ -2,47 +2,72 @@
 // Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
 
 #include "include/inet/buffer.hpp"
+#include "include/inet/buffer_pool.hpp"
 
-Buffer::Buffer(void *data, size_t size) : owns_data_(false) {
+#include <cstring>
+
+Buffer::Buffer(void *data, size_t size) : block_(nullptr) {
     data_ = data;
     size_ = size;
 }
 
 template<typename T, typename Allocator>
-Buffer::Buffer(std::vector<T, Allocator> &data) : owns_data_(false) {
+Buffer::Buffer(std::vector<T, Allocator> &data) : block_(nullptr) {
     data_ = data.data();
     size_ = sizeof(T) * data.size();
 }
 
-Buffer::Buffer(std::string data) : owns_data_(false) {
+Buffer::Buffer(std::string data) : block_(nullptr) {
     data_ = data.data();
     size_ = data.size();
 }
 
-Buffer::Buffer(size_t size) : owns_data_(true) {
-    data_ = new char[size];
+Buffer::Buffer(size_t size) : block_(BufferPool::allocate(size)) {
+    data_ = block_;
     size_ = size;
 }
 
-Buffer::Buffer(Buffer &&other) {
+Buffer Buffer::make_shared(size_t size) {
+    return Buffer(size);
+}
+
+Buffer Buffer::share() const {
+    if (block_ == nullptr) {
+        Buffer copy(size_);
+        std::memcpy(copy.data_, data_, size_);
+        return copy;
+    }
+
+    Buffer result(data_, size_);
+    BufferPool::retain(block_);
+    result.block_ = block_;
+
+    return result;
+}
+
+Buffer::Buffer(Buffer &&other) : block_(nullptr) {
     *this = std::move(other);
 }
 
 Buffer &Buffer::operator=(Buffer &&other) {
     if (this == &other) return *this;
 
-    owns_data_ = other.owns_data_;
+    // Release the memory that this buffer previously held
+    if (block_ != nullptr) BufferPool::release(block_);
+
+    block_ = other.block_;
     data_ = other.data_;
     size_ = other.size_;
 
     other.data_ = nullptr;
     other.size_ = 0;
+    other.block_ = nullptr;
 
     return *this;
 }
 
 Buffer::~Buffer() {
-    if (owns_data_) delete[] (char *)data_;
+    if (block_ != nullptr) BufferPool::release(block_);
 }
 
 void *Buffer::data() const {
@@ -55,4 +80,4 @@ size_t Buffer::size() const {
 
 Buffer Buffer::operator+(size_t offset) const {
     return Buffer((char *)data_ + offset, size_ - offset);
-}
\ No newline at end of file
+}
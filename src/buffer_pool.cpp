@@ -0,0 +1,184 @@
+// File: buffer_pool.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/inet/buffer_pool.hpp"
+#include "include/metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+// The size class of blocks that were allocated on their own, being too large for any other
+static const uint32_t OVERSIZE_CLASS = BufferPool::SIZE_CLASSES;
+
+// The most bytes of free blocks of one size that a thread keeps before handing half of them over
+static const size_t THREAD_CACHE_BYTES = 256 * 1024;
+
+// The fewest bytes of blocks carved out of the heap at once
+static const size_t SLAB_SIZE = 64 * 1024;
+
+// The blocks handed out, and how many times the heap had to be asked for memory to hand them out
+static Counter &pool_allocations = metrics().counter("buffer.allocations");
+static Counter &heap_allocations = metrics().counter("buffer.heap_allocations");
+
+// Describes the block that the memory right after it belongs to
+struct alignas(16) BlockHeader {
+    // The number of buffers referring to the block
+    std::atomic<uint32_t> references;
+
+    // The size class of the block, or `OVERSIZE_CLASS`
+    uint32_t size_class;
+
+    // The next block in the same free list, while the block is free
+    BlockHeader *next;
+};
+
+// Returns the number of bytes that blocks of `size_class` hold
+static size_t block_size(size_t size_class) { return BufferPool::MIN_BLOCK_SIZE << size_class; }
+
+// Returns the most free blocks of `size_class` that one thread keeps
+static size_t cache_limit(size_t size_class) {
+    return std::max<size_t>(2, THREAD_CACHE_BYTES / block_size(size_class));
+}
+
+// Represents a list of free blocks of one size
+struct FreeList {
+    BlockHeader *head = nullptr;
+    size_t count = 0;
+
+    void push(BlockHeader *block) {
+        block->next = head;
+        head = block;
+        count++;
+    }
+
+    BlockHeader *pop() {
+        BlockHeader *block = head;
+        head = block->next;
+        count--;
+        return block;
+    }
+
+    // Moves up to `amount` blocks from this list to `other`
+    void move_to(FreeList &other, size_t amount) {
+        while (amount-- > 0 && head != nullptr) other.push(pop());
+    }
+};
+
+// Holds the free blocks that threads handed over, for any thread to take
+struct CentralLists {
+    std::mutex locks[BufferPool::SIZE_CLASSES];
+    FreeList lists[BufferPool::SIZE_CLASSES];
+};
+
+// Returns the central lists, which are never destroyed so that threads outliving `main` can still
+// release their buffers
+static CentralLists &central() {
+    static CentralLists *lists = new CentralLists();
+    return *lists;
+}
+
+// Holds the free blocks of one thread, which are handed to the central lists when the thread exits
+struct ThreadCache {
+    FreeList lists[BufferPool::SIZE_CLASSES];
+
+    ~ThreadCache();
+};
+
+// True once the calling thread's cache has been destroyed, after which its blocks go straight to
+// the central lists
+static thread_local bool cache_destroyed = false;
+
+static thread_local ThreadCache cache;
+
+ThreadCache::~ThreadCache() {
+    cache_destroyed = true;
+    for (size_t size_class = 0; size_class < BufferPool::SIZE_CLASSES; size_class++) {
+        std::lock_guard<std::mutex> lock(central().locks[size_class]);
+        lists[size_class].move_to(central().lists[size_class], lists[size_class].count);
+    }
+}
+
+// Fills `list` with free blocks of `size_class`, from the central list if it has any and otherwise
+// from a new slab
+static void refill(FreeList &list, size_t size_class) {
+    {
+        std::lock_guard<std::mutex> lock(central().locks[size_class]);
+        central().lists[size_class].move_to(list, cache_limit(size_class) / 2);
+    }
+    if (list.count > 0) return;
+
+    size_t stride      = sizeof(BlockHeader) + block_size(size_class);
+    size_t block_count = std::max<size_t>(1, SLAB_SIZE / stride);
+    char *slab         = new char[stride * block_count];
+    heap_allocations.add();
+    for (size_t index = 0; index < block_count; index++) {
+        BlockHeader *block = new (slab + index * stride) BlockHeader();
+        block->size_class  = size_class;
+        list.push(block);
+    }
+}
+
+// BufferPool Public API Functions -----------------------------------------------------------------
+
+char *BufferPool::allocate(size_t size) {
+    pool_allocations.add();
+
+    BlockHeader *block;
+    if (size > MAX_BLOCK_SIZE) {
+        heap_allocations.add();
+        block = new (new char[sizeof(BlockHeader) + size]) BlockHeader();
+        block->size_class = OVERSIZE_CLASS;
+    } else {
+        // The smallest class whose blocks are at least `size` bytes, which is the number of bits
+        // that `size - 1` has beyond those of `MIN_BLOCK_SIZE - 1`
+        size_t size_class = size <= MIN_BLOCK_SIZE ? 0 : 64 - __builtin_clzll(size - 1) - 6;
+
+        if (cache_destroyed) {
+            FreeList list;
+            refill(list, size_class);
+            block = list.pop();
+            std::lock_guard<std::mutex> lock(central().locks[size_class]);
+            list.move_to(central().lists[size_class], list.count);
+        } else {
+            FreeList &list = cache.lists[size_class];
+            if (list.head == nullptr) refill(list, size_class);
+            block = list.pop();
+        }
+    }
+    block->references.store(1, std::memory_order_relaxed);
+
+    return (char *)(block + 1);
+}
+
+void BufferPool::retain(char *data) {
+    BlockHeader *block = (BlockHeader *)data - 1;
+    block->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BufferPool::release(char *data) {
+    BlockHeader *block = (BlockHeader *)data - 1;
+    if (block->references.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    size_t size_class = block->size_class;
+    if (size_class == OVERSIZE_CLASS) {
+        block->~BlockHeader();
+        delete[] (char *)block;
+        return;
+    }
+
+    if (cache_destroyed) {
+        std::lock_guard<std::mutex> lock(central().locks[size_class]);
+        central().lists[size_class].push(block);
+        return;
+    }
+
+    FreeList &list = cache.lists[size_class];
+    list.push(block);
+    if (list.count > cache_limit(size_class)) {
+        std::lock_guard<std::mutex> lock(central().locks[size_class]);
+        list.move_to(central().lists[size_class], list.count / 2);
+    }
+}
@@ -0,0 +1,374 @@
+// File: checkpoint.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/checkpoint.hpp"
+#include "include/metrics.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+void perror_and_exit(const char *header);
+
+// Identifies a checkpoint file
+static const char CHECKPOINT_MAGIC[8] = {'M', 'C', 'A', 'S', 'T', 'C', 'K', 'P'};
+
+// The version of the layout of checkpoint files
+static const uint32_t CHECKPOINT_VERSION = 2;
+
+// Where the last sequence number is in the file, right after the magic, the version and the number
+// of shards, which leaves it aligned so that it is never written halfway
+static const size_t LAST_SEQUENCE_OFFSET = sizeof(CHECKPOINT_MAGIC) + 2 * sizeof(uint32_t);
+
+// The smallest checkpoint file, which leaves room for plenty of deltas after a small snapshot
+static const size_t MIN_CAPACITY = 64 * 1024;
+
+// How many times larger than its snapshot a checkpoint file is made, to leave room for deltas
+static const size_t CAPACITY_FACTOR = 4;
+
+// The changes recorded as deltas, and how many snapshots were written
+static Counter &checkpoint_deltas = metrics().counter("checkpoint.deltas");
+static Counter &checkpoint_snapshots = metrics().counter("checkpoint.snapshots");
+
+// Appends the bytes of `value` to `out`
+template<typename T>
+static void put_field(std::string &out, const T &value) {
+    out.append((const char *)&value, sizeof(value));
+}
+
+// Reads `value` from `cursor` and moves past it
+//
+// Returns false if fewer bytes than it takes are left before `end`
+template<typename T>
+static bool get_field(const char *&cursor, const char *end, T &value) {
+    if ((size_t)(end - cursor) < sizeof(value)) return false;
+    std::memcpy(&value, cursor, sizeof(value));
+    cursor += sizeof(value);
+
+    return true;
+}
+
+// Returns the FNV-1a hash of `type` followed by the `size` bytes of `payload`
+static uint32_t record_checksum(uint8_t type, const char *payload, size_t size) {
+    uint32_t hash = 2166136261u;
+    hash          = (hash ^ type) * 16777619u;
+    for (size_t index = 0; index < size; index++) {
+        hash = (hash ^ (unsigned char)payload[index]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// Returns the record of `type` with `payload`
+static std::string encode_record(uint8_t type, const std::string &payload) {
+    std::string record;
+    put_field(record, (uint32_t)payload.size());
+    put_field(record, record_checksum(type, payload.data(), payload.size()));
+    put_field(record, type);
+    record += payload;
+
+    return record;
+}
+
+// Appends `value` to `out`, preceded by its size as a uint8
+static void put_string(std::string &out, const std::string &value) {
+    put_field(out, (uint8_t)value.size());
+    out += value;
+}
+
+// Reads a string written by `put_string` from `cursor` into `value` and moves past it
+//
+// Returns false if fewer bytes than it takes are left before `end`
+static bool get_string(const char *&cursor, const char *end, std::string &value) {
+    uint8_t size = 0;
+    if (!get_field(cursor, end, size) || (size_t)(end - cursor) < size) return false;
+    value.assign(cursor, size);
+    cursor += size;
+
+    return true;
+}
+
+// Returns the payload of the record holding `entry` for participant `pid`
+static std::string encode_entry(uint16_t pid, const CheckpointEntry &entry) {
+    std::string payload;
+    put_field(payload, pid);
+    put_field(payload, (uint8_t)entry.state);
+    put_field(payload, entry.port);
+    put_field(payload, (int64_t)entry.disconnect_time);
+    put_field(payload, entry.sequence);
+    put_field(payload, (uint8_t)entry.has_cursor);
+    put_field(payload, entry.cursor_from);
+    put_field(payload, (int64_t)entry.cursor_expires_at);
+    put_field(payload, entry.spilled_from);
+    put_string(payload, entry.ip);
+    put_field(payload, (uint16_t)entry.subscriptions.size());
+    for (const CheckpointSubscription &subscription : entry.subscriptions) {
+        put_field(payload, subscription.group);
+        put_field(payload, subscription.sequence);
+        put_field(payload, (uint8_t)subscription.has_cursor);
+        put_field(payload, subscription.cursor_from);
+        put_field(payload, (int64_t)subscription.cursor_expires_at);
+        put_string(payload, subscription.name);
+    }
+
+    return payload;
+}
+
+// Returns the record of `type` holding the sequence number `sequence` of `group`, for a record that
+// starts at `position` in the file
+//
+// The sequence number ends the record, padded so that it is aligned and never written halfway, and
+// is left out of the checksum since it is changed in place
+static std::string encode_group_sequence(uint8_t type, size_t position, uint32_t group,
+                                         uint64_t sequence) {
+    size_t fields  = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(group);
+    size_t padding = (sizeof(sequence) - (position + fields) % sizeof(sequence)) % sizeof(sequence);
+
+    std::string payload;
+    put_field(payload, group);
+    payload.append(padding, '\0');
+    uint32_t checksum = record_checksum(type, payload.data(), payload.size());
+    put_field(payload, sequence);
+
+    std::string record;
+    put_field(record, (uint32_t)payload.size());
+    put_field(record, checksum);
+    put_field(record, type);
+    record += payload;
+
+    return record;
+}
+
+// Checkpoint Public API Functions -----------------------------------------------------------------
+
+Checkpoint::Checkpoint(std::string path, size_t shard_count) :
+    path_(path), shard_count_(shard_count), last_sequence_(0), mapping_(nullptr), capacity_(0),
+    used_(0) {
+    load_();
+    snapshot_();
+}
+
+Checkpoint::~Checkpoint() {
+    if (mapping_ != nullptr) munmap(mapping_, capacity_);
+}
+
+const std::map<uint16_t, CheckpointEntry> &Checkpoint::entries() const { return entries_; }
+
+uint64_t Checkpoint::last_sequence() const { return last_sequence_; }
+
+const std::unordered_map<uint32_t, uint64_t> &Checkpoint::group_sequences() const {
+    return group_sequences_;
+}
+
+void Checkpoint::put(uint16_t pid, const CheckpointEntry &entry) {
+    if (entry.state == MemberState::UNREGISTERED) {
+        entries_.erase(pid);
+        std::string payload;
+        put_field(payload, pid);
+        append_(encode_record((uint8_t)RecordType::REMOVED, payload));
+        return;
+    }
+
+    entries_[pid] = entry;
+    append_(encode_record((uint8_t)RecordType::ENTRY, encode_entry(pid, entry)));
+}
+
+void Checkpoint::set_last_sequence(uint64_t sequence) {
+    last_sequence_ = sequence;
+    std::memcpy(mapping_ + LAST_SEQUENCE_OFFSET, &last_sequence_, sizeof(last_sequence_));
+}
+
+void Checkpoint::set_group_sequence(uint32_t group, uint64_t sequence) {
+    group_sequences_[group] = sequence;
+    auto slot = group_slots_.find(group);
+    if (slot != group_slots_.end()) {
+        std::memcpy(mapping_ + slot->second, &sequence, sizeof(sequence));
+        return;
+    }
+
+    // The first message of a group adds its record, which every later one is written into
+    size_t position = used_;
+    std::string record =
+        encode_group_sequence((uint8_t)RecordType::GROUP_SEQUENCE, position, group, sequence);
+    if (append_(record)) group_slots_[group] = position + record.size() - sizeof(sequence);
+}
+
+// Checkpoint Private API Functions ----------------------------------------------------------------
+
+void Checkpoint::load_() {
+    // There is nothing to load before the first coordinator has run
+    int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    struct stat status;
+    if (fstat(fd, &status) < 0) perror_and_exit("fstat() failed");
+    size_t size = status.st_size;
+    if (size < sizeof(CHECKPOINT_MAGIC)) {
+        close(fd);
+        return;
+    }
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) perror_and_exit("mmap() failed");
+
+    const char *cursor = (const char *)mapping;
+    const char *end    = cursor + size;
+    uint32_t version     = 0;
+    uint32_t shard_count = 0;
+    bool valid = std::memcmp(cursor, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0;
+    cursor += sizeof(CHECKPOINT_MAGIC);
+    valid = valid && get_field(cursor, end, version) && get_field(cursor, end, shard_count);
+    // Participants belong to other shards under a different number of shards, so such a checkpoint
+    // is left alone
+    valid = valid && version == CHECKPOINT_VERSION && shard_count == shard_count_;
+    valid = valid && get_field(cursor, end, last_sequence_);
+
+    // The file is zeroed past the last record, which fails its checksum like a torn record does
+    while (valid) {
+        uint32_t payload_size = 0;
+        uint32_t checksum     = 0;
+        uint8_t type          = 0;
+        if (!get_field(cursor, end, payload_size) || !get_field(cursor, end, checksum) ||
+            !get_field(cursor, end, type)) {
+            break;
+        }
+        if ((size_t)(end - cursor) < payload_size) break;
+        // The sequence number that ends the record of a group is left out of its checksum
+        size_t checked = payload_size;
+        if (type == (uint8_t)RecordType::GROUP_SEQUENCE) {
+            if (payload_size < sizeof(uint32_t) + sizeof(uint64_t)) break;
+            checked -= sizeof(uint64_t);
+        }
+        if (record_checksum(type, cursor, checked) != checksum) break;
+        if (!apply_((RecordType)type, cursor, payload_size)) break;
+        cursor += payload_size;
+    }
+
+    munmap(mapping, size);
+}
+
+bool Checkpoint::apply_(RecordType type, const char *payload, size_t size) {
+    const char *cursor = payload;
+    const char *end    = payload + size;
+
+    switch (type) {
+        case RecordType::ENTRY: {
+            uint16_t pid = 0;
+            uint8_t state = 0;
+            uint8_t has_cursor = 0;
+            int64_t disconnect_time = 0;
+            int64_t cursor_expires_at = 0;
+            CheckpointEntry entry;
+            bool complete = get_field(cursor, end, pid) && get_field(cursor, end, state) &&
+                            get_field(cursor, end, entry.port) &&
+                            get_field(cursor, end, disconnect_time) &&
+                            get_field(cursor, end, entry.sequence) &&
+                            get_field(cursor, end, has_cursor) &&
+                            get_field(cursor, end, entry.cursor_from) &&
+                            get_field(cursor, end, cursor_expires_at) &&
+                            get_field(cursor, end, entry.spilled_from) &&
+                            get_string(cursor, end, entry.ip);
+            uint16_t subscription_count = 0;
+            if (!complete || !get_field(cursor, end, subscription_count)) return false;
+            for (uint16_t index = 0; index < subscription_count; index++) {
+                CheckpointSubscription subscription;
+                uint8_t subscription_has_cursor = 0;
+                int64_t subscription_expires_at = 0;
+                complete = get_field(cursor, end, subscription.group) &&
+                           get_field(cursor, end, subscription.sequence) &&
+                           get_field(cursor, end, subscription_has_cursor) &&
+                           get_field(cursor, end, subscription.cursor_from) &&
+                           get_field(cursor, end, subscription_expires_at) &&
+                           get_string(cursor, end, subscription.name);
+                if (!complete) return false;
+
+                subscription.has_cursor        = subscription_has_cursor != 0;
+                subscription.cursor_expires_at = subscription_expires_at;
+                entry.subscriptions.push_back(std::move(subscription));
+            }
+
+            entry.state             = (MemberState)state;
+            entry.disconnect_time   = disconnect_time;
+            entry.has_cursor        = has_cursor != 0;
+            entry.cursor_expires_at = cursor_expires_at;
+            entries_[pid] = std::move(entry);
+            return true;
+        }
+        case RecordType::REMOVED: {
+            uint16_t pid = 0;
+            if (!get_field(cursor, end, pid)) return false;
+            entries_.erase(pid);
+            return true;
+        }
+        case RecordType::GROUP_SEQUENCE: {
+            uint32_t group    = 0;
+            uint64_t sequence = 0;
+            if (!get_field(cursor, end, group)) return false;
+            std::memcpy(&sequence, end - sizeof(sequence), sizeof(sequence));
+            group_sequences_[group] = sequence;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Checkpoint::append_(const std::string &record) {
+    // The change is already part of the entries, so the snapshot records it as well
+    if (used_ + record.size() > capacity_) {
+        snapshot_();
+        return false;
+    }
+
+    std::memcpy(mapping_ + used_, record.data(), record.size());
+    used_ += record.size();
+    checkpoint_deltas.add();
+
+    return true;
+}
+
+void Checkpoint::snapshot_() {
+    std::string contents(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    put_field(contents, CHECKPOINT_VERSION);
+    put_field(contents, (uint32_t)shard_count_);
+    put_field(contents, last_sequence_);
+    for (auto &[pid, entry] : entries_) {
+        contents += encode_record((uint8_t)RecordType::ENTRY, encode_entry(pid, entry));
+    }
+    group_slots_.clear();
+    for (auto &[group, sequence] : group_sequences_) {
+        contents += encode_group_sequence((uint8_t)RecordType::GROUP_SEQUENCE, contents.size(),
+                                          group, sequence);
+        group_slots_[group] = contents.size() - sizeof(sequence);
+    }
+
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t capacity = std::max(MIN_CAPACITY, CAPACITY_FACTOR * contents.size());
+    capacity        = (capacity + page_size - 1) / page_size * page_size;
+
+    // The snapshot is written beside the file and renamed over it, so a coordinator that stops
+    // halfway through leaves the previous checkpoint whole
+    std::string temporary = path_ + ".tmp";
+    int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) perror_and_exit("open() failed");
+    if (ftruncate(fd, capacity) < 0) perror_and_exit("ftruncate() failed");
+    void *mapping = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) perror_and_exit("mmap() failed");
+
+    std::memcpy(mapping, contents.data(), contents.size());
+    if (msync(mapping, contents.size(), MS_SYNC) < 0) perror_and_exit("msync() failed");
+    if (std::rename(temporary.c_str(), path_.c_str()) < 0) perror_and_exit("rename() failed");
+
+    if (mapping_ != nullptr) munmap(mapping_, capacity_);
+    mapping_  = (char *)mapping;
+    capacity_ = capacity;
+    used_     = contents.size();
+    checkpoint_snapshots.add();
+}
@@ -0,0 +1,194 @@
+// File: compression.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/compression.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// The number of bytes holding the uncompressed size in front of the block
+static const size_t SIZE_PREFIX = sizeof(uint32_t);
+
+// The shortest copy that is encoded, since shorter ones would not save anything
+static const size_t MIN_MATCH = 4;
+
+// The farthest back that a copy may reach, since offsets are encoded as uint16
+static const size_t MAX_OFFSET = UINT16_MAX;
+
+// The number of bits of the hash of a 4-byte string, which sets the size of the hash table
+static const size_t HASH_BITS = 12;
+
+// The number of bytes at the end of the input that never start a copy, and that copies never
+// reach into, so the block always ends with literals
+static const size_t MATCH_SEARCH_LIMIT = 12;
+static const size_t LAST_LITERALS      = 5;
+
+// The number of positions without a match after which the search starts skipping ahead, so data
+// that does not compress is passed over quickly
+static const size_t SKIP_TRIGGER = 6;
+
+// Maps the hash of each 4-byte string to the last position it was seen at, shared by every call
+// made on a thread so that it is only allocated once
+//
+// Positions are stored offset by `base`, which moves past every position of a call once it
+// returns, so the entries left by earlier calls read as empty without clearing the table.
+struct HashTable {
+    std::vector<uint32_t> slots = std::vector<uint32_t>(1 << HASH_BITS, 0);
+    uint32_t base               = 1;
+};
+
+// Returns the 4 bytes at `data` as one integer, which is only ever hashed or compared
+static inline uint32_t read32(const unsigned char *data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// Returns the slot of the hash table for the 4-byte string `value`
+static inline uint32_t hash4(uint32_t value) { return (value * 2654435761u) >> (32 - HASH_BITS); }
+
+// Appends the bytes that extend a length of 15 or more past what fits in a token
+static void write_length(std::string &out, size_t length) {
+    while (length >= 255) {
+        out.push_back((char)255);
+        length -= 255;
+    }
+    out.push_back((char)length);
+}
+
+// Reads the bytes that extend a length past what fits in a token, adding them to `length`
+//
+// Returns false if the input ends first
+static bool read_length(const unsigned char *in, size_t size, size_t &position, size_t &length) {
+    unsigned char byte;
+    do {
+        if (position >= size) return false;
+        byte = in[position++];
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+// Appends a sequence of `literal_length` bytes of `literals` followed by a copy of `match_length`
+// bytes from `offset` bytes back, or no copy at all if `match_length` is 0
+static void write_sequence(std::string &out, const unsigned char *literals, size_t literal_length,
+                           size_t offset, size_t match_length) {
+    size_t literal_token = std::min(literal_length, (size_t)15);
+    size_t match_token   = match_length > 0 ? std::min(match_length - MIN_MATCH, (size_t)15) : 0;
+    out.push_back((char)((literal_token << 4) | match_token));
+
+    if (literal_length >= 15) write_length(out, literal_length - 15);
+    out.append((const char *)literals, literal_length);
+    if (match_length == 0) return;
+
+    out.push_back((char)(offset & 0xFF));
+    out.push_back((char)(offset >> 8));
+    if (match_length - MIN_MATCH >= 15) write_length(out, match_length - MIN_MATCH - 15);
+}
+
+std::string compress_payload(const char *data, size_t size) {
+    const unsigned char *in = (const unsigned char *)data;
+
+    std::string out;
+    out.reserve(SIZE_PREFIX + size + size / 255 + 16);
+    for (size_t i = 0; i < SIZE_PREFIX; i++) out.push_back((char)((size >> (8 * i)) & 0xFF));
+
+    static thread_local HashTable table;
+    // Only cleared once the offset positions would no longer fit
+    if (size > UINT32_MAX - table.base) {
+        std::fill(table.slots.begin(), table.slots.end(), 0);
+        table.base = 1;
+    }
+
+    size_t anchor   = 0;
+    size_t position = 0;
+    if (size >= MATCH_SEARCH_LIMIT) {
+        size_t search_limit = size - MATCH_SEARCH_LIMIT;
+        size_t match_limit  = size - LAST_LITERALS;
+
+        while (position <= search_limit) {
+            uint32_t string   = read32(in + position);
+            uint32_t &slot    = table.slots[hash4(string)];
+            uint32_t previous = slot;
+            slot              = table.base + position;
+
+            // Entries below `base` were left by earlier calls, and point nowhere in this input
+            size_t candidate = previous - table.base;
+            bool found       = previous >= table.base && candidate < position
+                         && position - candidate <= MAX_OFFSET && read32(in + candidate) == string;
+            if (!found) {
+                position += 1 + ((position - anchor) >> SKIP_TRIGGER);
+                continue;
+            }
+
+            size_t match_end = position + MIN_MATCH;
+            while (match_end < match_limit && in[match_end] == in[candidate + match_end - position]) {
+                match_end++;
+            }
+
+            write_sequence(out, in + anchor, position - anchor, position - candidate,
+                           match_end - position);
+            position = match_end;
+            anchor   = position;
+        }
+        table.base += size;
+    }
+
+    write_sequence(out, in + anchor, size - anchor, 0, 0);
+
+    return out;
+}
+
+bool decompress_payload(const char *data, size_t size, std::string &result, size_t max_size) {
+    const unsigned char *in = (const unsigned char *)data;
+    if (size < SIZE_PREFIX) return false;
+
+    size_t raw_size = 0;
+    for (size_t i = 0; i < SIZE_PREFIX; i++) raw_size |= (size_t)in[i] << (8 * i);
+    if (raw_size > max_size) return false;
+
+    result.resize(raw_size);
+    size_t position = SIZE_PREFIX;
+    size_t written  = 0;
+
+    // Every length and offset is checked against what is left, so a malformed payload can never
+    // read or write out of bounds
+    while (true) {
+        if (position >= size) return false;
+        unsigned char token = in[position++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(in, size, position, literal_length)) return false;
+        if (literal_length > size - position || literal_length > raw_size - written) return false;
+        std::memcpy(&result[0] + written, in + position, literal_length);
+        position += literal_length;
+        written += literal_length;
+
+        // Only the last sequence has no copy
+        if (position == size) break;
+
+        if (size - position < 2) return false;
+        size_t offset = in[position] | (in[position + 1] << 8);
+        position += 2;
+        if (offset == 0 || offset > written) return false;
+
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !read_length(in, size, position, match_length)) return false;
+        match_length += MIN_MATCH;
+        if (match_length > raw_size - written) return false;
+
+        // A copy may overlap the bytes it produces, which repeats them
+        char *out = &result[0] + written;
+        if (offset >= match_length) {
+            std::memcpy(out, out - offset, match_length);
+        } else {
+            for (size_t i = 0; i < match_length; i++) out[i] = out[i - offset];
+        }
+        written += match_length;
+    }
+
+    return written == raw_size;
+}
@@ -0,0 +1,80 @@
+// File: connection_pool.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/connection_pool.hpp"
+
+#include <cerrno>
+
+ConnectionPool::ConnectionPool(std::chrono::milliseconds send_timeout) : send_timeout_(send_timeout) {}
+
+void ConnectionPool::open(uint16_t pid, std::string ip, uint16_t port) {
+    std::string port_str = std::to_string((int)port);
+
+    InternetAddress address = InternetAddress::from_ip_address(ip.c_str(), port_str.c_str());
+
+    // References to map elements stay valid while other elements are added or removed, so the
+    // participant may be dialed without holding the lock
+    std::unique_lock<std::mutex> lock(connections_lock_);
+    PooledConnection &connection = connections_[pid];
+    lock.unlock();
+
+    connection.address = address;
+    redial_(connection);
+}
+
+SendResult ConnectionPool::send(uint16_t pid, const Buffer &data) {
+    return send_(pid, [&data](InternetSocket &socket) { return socket.try_sendall(data); });
+}
+
+SendResult ConnectionPool::sendv(uint16_t pid, const std::vector<Buffer> &data) {
+    return send_(pid, [&data](InternetSocket &socket) { return socket.try_sendv(data); });
+}
+
+void ConnectionPool::close(uint16_t pid) {
+    // Destroying the socket closes it, which sends the participant an orderly end of stream
+    std::lock_guard<std::mutex> lock(connections_lock_);
+    connections_.erase(pid);
+}
+
+bool ConnectionPool::redial_(PooledConnection &connection) {
+    connection.socket    = InternetSocket();
+    connection.connected = connection.socket.try_connect(connection.address);
+    if (connection.connected) connection.socket.do_set_nodelay();
+    if (connection.connected && send_timeout_.count() > 0) connection.socket.do_set_send_timeout(send_timeout_);
+
+    return connection.connected;
+}
+
+template <typename SendOn>
+SendResult ConnectionPool::send_(uint16_t pid, SendOn send_on) {
+    PooledConnection *entry = find_(pid);
+    if (entry == nullptr) return SendResult::FAILED;
+
+    PooledConnection &connection = *entry;
+    auto attempt = [&]() {
+        if (send_on(connection.socket)) return SendResult::SENT;
+        connection.connected = false;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return SendResult::FAILED;
+
+        // Part of the data may already be out, so nothing more can follow it on this connection
+        connection.socket = InternetSocket();
+        return SendResult::TIMED_OUT;
+    };
+    if (connection.connected) {
+        SendResult result = attempt();
+        if (result != SendResult::FAILED) return result;
+    }
+
+    // The connection was never made or has broken since it was last used, so dial the participant
+    // again and retry the whole message on the fresh connection
+    if (!redial_(connection)) return SendResult::FAILED;
+
+    return attempt();
+}
+
+ConnectionPool::PooledConnection *ConnectionPool::find_(uint16_t pid) {
+    std::lock_guard<std::mutex> lock(connections_lock_);
+
+    auto entry = connections_.find(pid);
+    return (entry != connections_.end()) ? &entry->second : nullptr;
+}
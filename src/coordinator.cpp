@@ -3,105 +3,664 @@
 
 #include "include/coordinator.hpp"
 #include "include/multicast_message.hpp"
+#include "include/trace.hpp"
 
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <sstream>
 #include <fstream>
 
-Coordinator::Coordinator(uint16_t localport, int persistence_time) :
-    localport_(localport), persistence_time_(persistence_time)
-{ }
+// The event loop token that identifies the listener of a shard
+static const uint64_t COORDINATOR_TOKEN = 0;
+
+// The number of connections that may wait to be accepted by the listener of a shard
+static const size_t LISTEN_BACKLOG = 1024;
+
+// How often messages that fell out of every persistence window are removed from the message log
+static const std::chrono::seconds COMPACTION_INTERVAL(1);
+
+// The number of messages that may wait in the queue from one shard to another
+static const size_t SHARD_QUEUE_CAPACITY = 16 * 1024;
+
+// The session token of forwarded requests that have been acknowledged already
+static const uint64_t NO_SESSION = 0;
+
+// How long a shard waits before retrying messages that did not fit in the queue of another shard
+static const int SHARD_RETRY_TIMEOUT = 1;
+
+// How often a shard checks whether participants whose messages are being spilled have caught up
+static const int SPILL_CHECK_TIMEOUT = 10;
+
+// How long a shard that ran out of file descriptors or memory waits before accepting again
+static const int ACCEPT_RETRY_TIMEOUT = 100;
+
+// The requests that the coordinator handled of each type, indexed by type, or nullptr for types
+// that are not requests
+static const std::vector<Counter *> requests_handled = [] {
+    std::vector<Counter *> counters(UINT8_MAX + 1, nullptr);
+    for (MulticastMessageType type : {MulticastMessageType::PARTICIPANT_REGISTER, MulticastMessageType::PARTICIPANT_DEREGISTER, MulticastMessageType::PARTICIPANT_DISCONNECT, MulticastMessageType::PARTICIPANT_RECONNECT, MulticastMessageType::PARTICIPANT_MSEND, MulticastMessageType::PARTICIPANT_QUIT, MulticastMessageType::PARTICIPANT_STATS, MulticastMessageType::PARTICIPANT_SUBSCRIBE, MulticastMessageType::PARTICIPANT_UNSUBSCRIBE}) {
+        std::string name = type_name(type);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        counters[(size_t)type] = &metrics().counter("coordinator.requests." + name);
+    }
+    return counters;
+}();
+
+// How long handing a multicast message to every shard and mailbox takes, and how large they are
+static Histogram &msend_fanout_time = metrics().histogram("coordinator.msend_fanout_ns");
+static Counter &msend_bytes = metrics().counter("coordinator.msend_bytes");
+
+// How often participants fell too far behind, by what happened to them
+static Counter &overflow_disconnects = metrics().counter("coordinator.overflow_disconnects");
+static Counter &overflow_spills = metrics().counter("coordinator.overflow_spills");
+
+Coordinator::Shard::Shard(size_t index, size_t shard_count, std::string log_directory, DeliveryOptions delivery_options) :
+    index(index), log_directory(log_directory), members(shard_count), delivery_pool(delivery_options), message_log(log_directory), checkpoint(log_directory + "/checkpoint", shard_count), overflow(shard_count), pending_wakes(shard_count, false)
+{
+    for (size_t source = 0; source < shard_count; source++) {
+        this->inbound.push_back(std::make_unique<SpscQueue<ShardMessage>>(SHARD_QUEUE_CAPACITY));
+    }
+}
+
+Coordinator::Coordinator(uint16_t localport, int persistence_time, DeliveryOptions delivery_options, size_t shard_count, size_t compression_threshold, size_t max_frame_size, std::string stats_path, std::chrono::seconds stats_interval) :
+    localport_(localport), persistence_time_(persistence_time), compression_threshold_(compression_threshold),
+    max_frame_size_(std::max(max_frame_size, 2 * MulticastMessageHeader::MAX_SIZE)), stats_path_(stats_path), stats_interval_(stats_interval)
+{
+    // A single shard keeps its log where the coordinator always has, every other layout gets one
+    // directory per shard
+    std::string log_directory = std::to_string(localport) + "_message_log";
+    for (size_t index = 0; index < shard_count; index++) {
+        std::string shard_directory = shard_count == 1 ? log_directory : log_directory + "/shard_" + std::to_string(index);
+        this->shards_.push_back(std::make_unique<Shard>(index, shard_count, shard_directory, delivery_options));
+    }
+}
 
 void Coordinator::start() {
-    std::cout << "[Coordinator Message] Coordinator Starting - Listening on Port " 
-        + std::to_string(this->localport_) 
+    const DeliveryOptions &delivery_options = this->shards_.front()->delivery_pool.options();
+    std::cout << "[Coordinator Message] Coordinator Starting - Listening on Port "
+        + std::to_string(this->localport_)
         + " with a persistence time of "
         + std::to_string(this->persistence_time_)
-        + " seconds"
+        + " seconds, "
+        + std::to_string(this->shards_.size())
+        + " shards of "
+        + std::to_string(delivery_options.workers)
+        + " delivery workers and batches of up to "
+        + std::to_string(delivery_options.batch_max_bytes)
+        + " bytes lingering "
+        + std::to_string(delivery_options.batch_linger.count())
+        + " microseconds, accepting frames of up to "
+        + std::to_string(this->max_frame_size_)
+        + " bytes"
         + "\n";
+    if (this->compression_threshold_ > 0) {
+        std::cout << "[Coordinator Message] Participants compress msend bodies of at least " + std::to_string(this->compression_threshold_) + " bytes\n";
+    }
+    this->restoreCheckpoints();
     this->is_running_ = true;
-    this->coordinator_socket_.do_bind(this->localport_);
+    // Every shard listens on the coordinator port, and the kernel spreads new connections across them
+    for (std::unique_ptr<Shard> &shard : this->shards_) {
+        if (this->shards_.size() > 1) shard->socket.do_set_reuseport();
+        shard->socket.do_bind(this->localport_);
+        shard->socket.do_listen(LISTEN_BACKLOG);
+    }
     std::cout << "[Coordinator Message] Coordinator Succesfully Binded to Port " + std::to_string(this->localport_) + "\n";
-    this->coordinator_socket_.do_listen(10);
-    std::cout << "[Coordinator Message] Coordinator Port " + std::to_string(this->localport_) + " Currently Listening With a Backlog of 10" + "\n";
-    incoming_messages_thread_ = std::thread(&Coordinator::handleIncomingMessages, this);
-    incoming_messages_thread_.join();
+    std::cout << "[Coordinator Message] Coordinator Port " + std::to_string(this->localport_) + " Currently Listening With a Backlog of " + std::to_string(LISTEN_BACKLOG) + "\n";
+    compaction_thread_ = std::thread(&Coordinator::compactMessageLog, this);
+    // The last report is written once every shard has stopped
+    std::unique_ptr<StatsWriter> stats_writer;
+    if (!this->stats_path_.empty()) {
+        stats_writer = std::make_unique<StatsWriter>(this->stats_path_, this->stats_interval_, [this] { return this->backlogReport(); });
+        std::cout << "[Coordinator Message] Writing metrics to " + this->stats_path_ + " every " + std::to_string(this->stats_interval_.count()) + " seconds\n";
+    }
+#ifdef MULTICAST_TRACE
+    std::string trace_path = "coordinator_" + std::to_string(this->localport_) + "_trace.json";
+    TraceWriter trace_writer(trace_path, DEFAULT_TRACE_INTERVAL);
+    std::cout << "[Coordinator Message] Writing trace spans to " + trace_path + "\n";
+#endif
+    for (std::unique_ptr<Shard> &shard : this->shards_) {
+        shard->thread = std::thread(&Coordinator::handleIncomingMessages, this, std::ref(*shard));
+    }
+    for (std::unique_ptr<Shard> &shard : this->shards_) {
+        shard->thread.join();
+    }
+    compaction_thread_.join();
     return;
 }
 
-void Coordinator::stop() { this->is_running_ = false; }
+void Coordinator::stop() {
+    {
+        std::lock_guard<std::mutex> lock(this->compaction_lock_);
+        this->is_running_ = false;
+    }
+    this->compaction_cv_.notify_all();
+    for (std::unique_ptr<Shard> &shard : this->shards_) {
+        shard->event_loop.do_wake();
+    }
+}
 
-void Coordinator::handleIncomingMessages() {
-    PollInfo connection_request;
-    connection_request.readable  = true;
-    connection_request.writeable = false;
+void Coordinator::handleOverflow(Shard &shard, uint16_t pid, uint32_t group, uint64_t sequence) {
+    MailboxDepth depth = shard.delivery_pool.depth(pid);
+    time_t now = std::time(0);
+    // Either way the participant misses everything from this message on, which the message logs
+    // keep for it just as if it had disconnected
+    shard.message_log.open_cursor(pid, now + this->persistence_time_);
+    for (uint32_t subscribed : shard.groups.groups(pid)) {
+        this->groupLog(shard, subscribed).open_cursor(pid, now + this->persistence_time_);
+        shard.groups.set_sequence(subscribed, pid, subscribed == group ? sequence - 1 : shard.group_sequences[subscribed]);
+    }
+    // The first message addressed to everyone that the participant misses
+    uint64_t missed_from = group == 0 ? sequence : shard.last_sequence + 1;
+    if (shard.delivery_pool.options().overflow_policy == OverflowPolicy::DISCONNECT) {
+        // The participant is told after the messages it was already sent, and has to reconnect
+        MulticastMessage notice(MulticastMessageType::PARTICIPANT_EVICTED, pid, now);
+        shard.delivery_pool.evict(pid, notice.to_shared_buffer());
+        shard.members.disconnect(pid, now, missed_from - 1);
+        this->checkpointMember(shard, pid);
+        overflow_disconnects.add();
+        std::cout << "[Coordinator Message] Disconnected participant #" << pid << ", which fell " << depth.messages << " messages (" << depth.bytes << " bytes) behind\n";
+        return;
+    }
+    shard.spilling[pid] = missed_from;
+    this->checkpointMember(shard, pid);
+    overflow_spills.add();
+    std::cout << "[Coordinator Message] Participant #" << pid << " fell " << depth.messages << " messages (" << depth.bytes << " bytes) behind, storing its messages until it catches up\n";
+}
 
-    // TODO: Implement
+void Coordinator::resumeSpilled(Shard &shard) {
+    for (auto entry = shard.spilling.begin(); entry != shard.spilling.end();) {
+        uint16_t pid = entry->first;
+        if (!shard.delivery_pool.caught_up(pid)) {
+            entry++;
+            continue;
+        }
+        // The stored messages are replayed from the mailbox, so they go out before any new ones
+        this->replayCursor(shard, pid, shard.message_log, shard.message_log.seek(entry->second - 1));
+        // Each group's cursor was placed when the participant fell behind, so it starts at the
+        // first message of the group that was stored for it
+        for (uint32_t group : shard.groups.groups(pid)) {
+            MessageLog &log = this->groupLog(shard, group);
+            MessageLog::Cursor cursor;
+            if (log.find_cursor(pid, cursor)) this->replayCursor(shard, pid, log, cursor.from);
+        }
+        entry = shard.spilling.erase(entry);
+        this->checkpointMember(shard, pid);
+    }
+}
+
+void Coordinator::checkpointMember(Shard &shard, uint16_t pid) {
+    CheckpointEntry entry;
+    entry.state = shard.members.state(pid);
+    if (entry.state != MemberState::UNREGISTERED) {
+        entry.ip = shard.members.ip(pid);
+        entry.port = shard.members.port(pid);
+    }
+    if (entry.state == MemberState::DISCONNECTED) {
+        entry.disconnect_time = shard.members.disconnect_time(pid);
+        entry.sequence = shard.members.sequence(pid);
+    }
+    MessageLog::Cursor cursor;
+    if (shard.message_log.find_cursor(pid, cursor)) {
+        entry.has_cursor = true;
+        entry.cursor_from = cursor.from;
+        entry.cursor_expires_at = cursor.expires_at;
+    }
+    auto spilled = shard.spilling.find(pid);
+    if (spilled != shard.spilling.end()) entry.spilled_from = spilled->second;
+    for (uint32_t group : shard.groups.groups(pid)) {
+        CheckpointSubscription subscription;
+        subscription.group = group;
+        subscription.name = this->groupName(group);
+        subscription.sequence = shard.groups.sequence(group, pid);
+        if (this->groupLog(shard, group).find_cursor(pid, cursor)) {
+            subscription.has_cursor = true;
+            subscription.cursor_from = cursor.from;
+            subscription.cursor_expires_at = cursor.expires_at;
+        }
+        entry.subscriptions.push_back(std::move(subscription));
+    }
+    shard.checkpoint.put(pid, entry);
+}
+
+void Coordinator::restoreCheckpoints() {
+    auto started = std::chrono::steady_clock::now();
+    time_t now = std::time(0);
+    size_t connected = 0;
+    size_t disconnected = 0;
+    for (std::unique_ptr<Shard> &shard : this->shards_) {
+        // Shards other than the sequencer may not have delivered every message it numbered
+        shard->last_sequence = shard->checkpoint.last_sequence();
+        for (auto &[group, sequence] : shard->checkpoint.group_sequences()) shard->group_sequences[group] = sequence;
+        for (auto &[pid, entry] : shard->checkpoint.entries()) {
+            shard->members.add(pid, entry.ip, entry.port);
+            if (entry.has_cursor) shard->message_log.restore_cursor(pid, entry.cursor_from, entry.cursor_expires_at);
+            for (const CheckpointSubscription &subscription : entry.subscriptions) {
+                this->claimGroupName(subscription.group, subscription.name);
+                shard->groups.subscribe(subscription.group, pid);
+                shard->groups.set_sequence(subscription.group, pid, subscription.sequence);
+                MessageLog &log = this->groupLog(*shard, subscription.group);
+                if (subscription.has_cursor) log.restore_cursor(pid, subscription.cursor_from, subscription.cursor_expires_at);
+            }
+            if (entry.state == MemberState::DISCONNECTED) {
+                shard->members.disconnect(pid, entry.disconnect_time, entry.sequence);
+                disconnected++;
+                continue;
+            }
+            // Delivery carries on over a fresh connection, which the participant accepts like the
+            // one it had before
+            shard->delivery_pool.open(pid, entry.ip, entry.port);
+            if (entry.spilled_from > 0) shard->spilling[pid] = entry.spilled_from;
+            connected++;
+        }
+        // Whatever the restored cursors do not refer to was only kept for participants that have
+        // reconnected or deregistered since, and the logs of groups nobody subscribes to anymore
+        // are not needed at all
+        shard->message_log.compact(now);
+        for (auto &[group, log] : shard->group_logs) log->compact(now);
+        for (const auto &directory : std::filesystem::directory_iterator(shard->log_directory)) {
+            std::string name = directory.path().filename().string();
+            if (!directory.is_directory() || name.rfind("group_", 0) != 0) continue;
+            if (shard->group_logs.count(std::strtoul(name.c_str() + 6, nullptr, 10)) == 0) std::filesystem::remove_all(directory.path());
+        }
+    }
+    if (connected + disconnected == 0) return;
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+    std::cout << "[Coordinator Message] Restored " << connected << " connected and " << disconnected
+        << " disconnected participants from checkpoints in " << elapsed.count()
+        << " microseconds, numbering messages from " << this->shards_.front()->last_sequence + 1 << "\n";
+}
+
+std::string Coordinator::backlogReport() {
+    // Each participant is owned by one shard, whose delivery pool and message log both lock
+    // themselves, so they are read here without stopping the shards
+    std::map<uint16_t, std::pair<MailboxDepth, uint64_t>> backlogs;
+    for (std::unique_ptr<Shard> &shard : this->shards_) {
+        for (auto &entry : shard->delivery_pool.depths()) backlogs[entry.first].first = entry.second;
+        for (auto &entry : shard->message_log.backlogs()) backlogs[entry.first].second += entry.second;
+        std::lock_guard<std::mutex> lock(shard->group_logs_lock);
+        for (auto &[group, log] : shard->group_logs) {
+            for (auto &entry : log->backlogs()) backlogs[entry.first].second += entry.second;
+        }
+    }
+
+    std::ostringstream report;
+    for (auto &entry : backlogs) {
+        const MailboxDepth &depth = entry.second.first;
+        report << "backlog.participant_" << entry.first
+            << " waiting_messages=" << depth.messages
+            << " waiting_bytes=" << depth.bytes
+            << " dropped=" << depth.dropped
+            << " stored_bytes=" << entry.second.second << "\n";
+    }
+    return report.str();
+}
+
+void Coordinator::compactMessageLog() {
+    // Segments are also deleted as soon as replays finish, so report everything reclaimed since
+    // the last pass, not just what this pass deleted
+    uint64_t reported = 0;
+    std::unique_lock<std::mutex> lock(this->compaction_lock_);
     while (this->is_running_) {
-        // poll to see if there are any connection requests
-        PollInfo result = this->coordinator_socket_.do_poll(connection_request, 1 * 1000 /* timeout after 1 second */);
-        if (!result.valid || (result.valid && !result.readable)) continue;
+        this->compaction_cv_.wait_for(lock, COMPACTION_INTERVAL, [this] { return !this->is_running_; });
+
+        uint64_t reclaimed = 0;
+        for (std::unique_ptr<Shard> &shard : this->shards_) {
+            shard->message_log.compact(std::time(0));
+            reclaimed += shard->message_log.reclaimed_bytes();
+            std::lock_guard<std::mutex> group_logs_lock(shard->group_logs_lock);
+            for (auto &[group, log] : shard->group_logs) {
+                log->compact(std::time(0));
+                reclaimed += log->reclaimed_bytes();
+            }
+        }
+        if (reclaimed > reported) {
+            std::cout << "[Coordinator Message] Reclaimed " + std::to_string(reclaimed - reported)
+                + " bytes of stored messages (" + std::to_string(reclaimed) + " bytes in total)\n";
+            reported = reclaimed;
+        }
+    }
+}
+
+void Coordinator::handleIncomingMessages(Shard &shard) {
+    // With more than one shard, each shard keeps a core to itself, picked among the cores this
+    // process is allowed to run on
+    if (this->shards_.size() > 1) {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        int result = sched_getaffinity(0, sizeof(allowed), &allowed) == 0 ? 0 : errno;
+        int allowed_count = result == 0 ? CPU_COUNT(&allowed) : 0;
+        if (allowed_count > 0) {
+            // Shards take the allowed cores in turn
+            size_t skip = shard.index % allowed_count;
+            int cpu = 0;
+            while (!CPU_ISSET(cpu, &allowed) || skip-- > 0) cpu++;
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+        if (result != 0) {
+            std::cout << "[Coordinator Message] Could not pin shard " + std::to_string(shard.index) + " to a core: " + std::strerror(result) + "\n";
+        }
+    }
+
+    // Every connection of the shard is served from this one thread, so no socket may ever block it
+    std::vector<LoopEvent> events;
+    shard.socket.do_set_nonblocking();
+    shard.event_loop.do_add(shard.socket, COORDINATOR_TOKEN);
+    bool retry_pending = false;
+    bool accept_pending = false;
+
+    while (this->is_running_) {
+        // Other shards wake this loop up whenever they queue messages for it
+        int timeout = -1 /* until a socket changes state or stop() is called */;
+        if (!shard.spilling.empty()) timeout = SPILL_CHECK_TIMEOUT;
+        if (accept_pending) timeout = ACCEPT_RETRY_TIMEOUT;
+        if (retry_pending) timeout = SHARD_RETRY_TIMEOUT;
+        {
+            TRACE_SPAN("coordinator.wait");
+            shard.event_loop.do_wait(events, timeout);
+        }
+        {
+            TRACE_SPAN("coordinator.shard_messages");
+            this->receiveShardMessages(shard);
+            if (!shard.spilling.empty()) this->resumeSpilled(shard);
+        }
+        // Connections left waiting for lack of file descriptors raise no further notification, so
+        // they are retried until they have all been accepted
+        if (accept_pending) {
+            TRACE_SPAN("coordinator.accept");
+            accept_pending = !this->acceptSessions(shard);
+            if (!accept_pending) std::cout << "[Coordinator Message] Accepting connections again\n";
+        }
+
+        for (LoopEvent &event : events) {
+            if (event.token == COORDINATOR_TOKEN) {
+                if (accept_pending) continue;
+                TRACE_SPAN("coordinator.accept");
+                accept_pending = !this->acceptSessions(shard);
+                if (accept_pending) std::cout << "[Coordinator Message] Ran out of file descriptors or memory, new connections wait until sessions close\n";
+                continue;
+            }
+
+            auto entry = shard.sessions.find(event.token);
+            if (entry == shard.sessions.end()) continue;
+
+            TRACE_SPAN("coordinator.session");
+            Session &session = *entry->second;
+            bool keep_session = true;
+            if (event.writeable) keep_session = this->flushSession(session);
+            if (keep_session && (event.readable || event.closed)) keep_session = this->readSession(shard, event.token, session);
+
+            if (!keep_session) {
+                shard.event_loop.do_remove(session.socket);
+                shard.sessions.erase(entry);
+            }
+        }
+
+        // Other shards are only woken up once for everything this pass queued for them
+        TRACE_SPAN("coordinator.wake_shards");
+        retry_pending = this->flushShardMessages(shard);
+    }
+}
 
-        // We do not execute from here on forward if there is no connection from a participant
-        InternetSocket part_socket = this->coordinator_socket_.do_accept();
+bool Coordinator::acceptSessions(Shard &shard) {
+    // Notifications are edge-triggered, so every waiting connection must be accepted now
+    while (true) {
+        bool exhausted = false;
+        InternetSocket part_socket = shard.socket.try_accept(&exhausted);
+        if (!part_socket.is_valid()) return !exhausted;
+        part_socket.do_set_nodelay();
 
-        // Participant will only seek to connect when it is about to send a message, otherwise it would not connect
-        // Get the message header
-        Buffer recv_buffer(sizeof(MulticastMessageHeader));
-        size_t bytes_recv = part_socket.do_recv(recv_buffer, MSG_PEEK);
+        uint64_t token = shard.next_session_token++;
+        std::unique_ptr<Session> session = std::make_unique<Session>(std::move(part_socket), this->max_frame_size_);
+        session->part_ip = session->socket.remote_addr().substr(0, session->socket.remote_addr().find(":"));
+        shard.event_loop.do_add(session->socket, token);
+        shard.sessions.insert({token, std::move(session)});
+    }
+}
+
+bool Coordinator::readSession(Shard &shard, uint64_t token, Session &session) {
+    // Notifications are edge-triggered, so keep receiving until the socket would block
+    while (true) {
+        TransferInfo result = session.reader.try_fill(session.socket);
+
+        // Handle every request that is complete, however many arrived in the same read
+        MulticastMessageHeader header;
+        Buffer body(nullptr, 0);
+        while (session.reader.next(header, body)) {
+            std::string data((char *)body.data(), body.size());
+            if (!this->dispatchRequest(shard, token, session, header, std::move(data))) return false;
+        }
+        // A frame larger than the limit would have to be held in full before it could be handled,
+        // so the session is dropped instead of receiving it
+        if (session.reader.oversized()) {
+            std::cout << "[Coordinator Message] Dropped a session that sent a frame larger than " << this->max_frame_size_ << " bytes\n";
+            return false;
+        }
 
-        // Return if the socket closed (recv() returns 0)
-        if (bytes_recv == 0) continue;
+        if (result.closed) return false;
+        if (result.would_block) return true;
+    }
+}
 
-        part_socket.do_recvall(recv_buffer);
+bool Coordinator::dispatchRequest(Shard &shard, uint64_t token, Session &session, MulticastMessageHeader header, std::string data) {
+    MulticastMessage part_req(header.type, header.pid, header.coordinator_time);
+    part_req << std::move(data);
+    if (header.flags & HEADER_FLAG_COMPRESSED) part_req.set_compressed();
+    if (header.flags & HEADER_FLAG_GROUP) part_req.set_group(header.group);
+    part_req.set_chunk_flags(header.flags);
 
-        MulticastMessageHeader header = MulticastMessageHeader::from_buffer(recv_buffer);
+    // Registering negotiates the version of the wire format, so a participant may register with a
+    // newer version than this coordinator speaks, but must use the agreed version from then on. Only
+    // requests are checked, since deliveries are always sent with PROTOCOL_VERSION
+    bool registering = header.type == MulticastMessageType::PARTICIPANT_REGISTER;
+    bool supported = header.version >= MIN_PROTOCOL_VERSION && (registering || header.version <= PROTOCOL_VERSION);
+    // Compressed bodies are forwarded and stored as they are, so while compression is enabled every
+    // participant must be able to read them, and otherwise none may be sent
+    bool compressed = header.flags & HEADER_FLAG_COMPRESSED;
+    if (registering && this->compression_threshold_ > 0 && !compressed) supported = false;
+    if (header.type == MulticastMessageType::PARTICIPANT_MSEND && compressed && this->compression_threshold_ == 0) supported = false;
+
+    if (part_req.header().type == MulticastMessageType::INVALID || !supported) {
+        MulticastMessage nack(MulticastMessageType::NEGATIVE_ACKNOWLEDGEMENT, part_req.header().pid, std::time(0));
+        if (header.flags & HEADER_FLAG_REQUEST_ID) nack.set_request_id(header.request_id);
+        nack.append_to(session.outbound);
+        this->flushSession(session);
+        return false;
+    }
 
-        // Get the message data (the message that was sent over multicast)
-        Buffer data_buffer(header.size);
-        std::string data;
-        if (header.size > 0) {
-            part_socket.do_recvall(data_buffer);
-            data = std::string((char *)data_buffer.data(), header.size);
+    // A group can only be subscribed to under a valid name whose id no other name has claimed, which
+    // is refused without dropping the session
+    bool group_request = header.type == MulticastMessageType::PARTICIPANT_SUBSCRIBE || header.type == MulticastMessageType::PARTICIPANT_UNSUBSCRIBE;
+    if (group_request) {
+        const std::string &name = part_req.body();
+        bool valid = !name.empty() && name.size() <= MAX_GROUP_NAME_SIZE && name.find(' ') == std::string::npos;
+        if (!valid || (header.type == MulticastMessageType::PARTICIPANT_SUBSCRIBE && !this->claimGroupName(group_id(name), name))) {
+            MulticastMessage nack(MulticastMessageType::NEGATIVE_ACKNOWLEDGEMENT, header.pid, std::time(0));
+            if (header.flags & HEADER_FLAG_REQUEST_ID) nack.set_request_id(header.request_id);
+            nack.append_to(session.outbound);
+            std::cout << "[Participant Request] " << header << " refused, " << (valid ? "its group's id belongs to another group" : "its group name is invalid") << "\n";
+            return this->flushSession(session);
         }
-        MulticastMessage part_req(header.type, header.pid, header.coordinator_time);
-        part_req << data;
+    }
 
-        if (part_req.header().type != MulticastMessageType::INVALID) {
-            MulticastMessage ack(MulticastMessageType::ACKNOWLEDGEMENT, part_req.header().pid, std::time(0));
-            part_socket.do_sendall(ack.to_buffer());
+    // Multicast messages are numbered by the sequencer and acknowledged as soon as they are accepted.
+    // Requests that change a participant's membership are handled by the shard that owns it, and
+    // only acknowledged once they have been, so that the participant's next request cannot overtake
+    // them on its way through another shard
+    bool multicast = part_req.header().type == MulticastMessageType::PARTICIPANT_MSEND;
+    // Statistics are gathered from every shard anyway, so the shard a STATS request arrives on
+    // answers it
+    bool stats = part_req.header().type == MulticastMessageType::PARTICIPANT_STATS;
+    Shard &handler = multicast ? *this->shards_.front() : (stats ? shard : this->owner(part_req.header().pid));
+    if (&handler != &shard) {
+        ShardMessage request;
+        request.kind = ShardMessage::Kind::REQUEST;
+        request.header = header;
+        request.body = part_req.body();
+        request.part_ip = session.part_ip;
+        request.session = multicast ? NO_SESSION : token;
+        this->sendShardMessage(shard, handler.index, std::move(request));
+        if (!multicast) {
             std::cout << "[Participant Request] " << header << "\n";
-            std::string part_ip = part_socket.remote_addr().substr(0, part_socket.remote_addr().find(":"));
-            this->handleRequest(part_req, part_ip);
+            return true;
+        }
+    }
+
+    bool keep_session = true;
+    {
+        TRACE_SPAN("coordinator.acknowledge");
+        MulticastMessage ack = this->acknowledge(header);
+        ack.append_to(session.outbound);
+        keep_session = this->flushSession(session);
+    }
+    std::cout << "[Participant Request] " << header << "\n";
+    if (&handler == &shard) this->handleRequest(shard, part_req, session.part_ip);
+
+    return keep_session;
+}
+
+MulticastMessage Coordinator::acknowledge(MulticastMessageHeader header) {
+    MulticastMessage ack(MulticastMessageType::ACKNOWLEDGEMENT, header.pid, std::time(0));
+    ack.set_version(std::min(header.version, PROTOCOL_VERSION));
+    // Participants pipeline their requests, and match each answer to its request by this id
+    if (header.flags & HEADER_FLAG_REQUEST_ID) ack.set_request_id(header.request_id);
+    // Registering also tells the participant from what size to compress msends (0 if it should not),
+    // the largest frame it may send and the largest batch of messages it may be sent, separated by
+    // spaces
+    if (header.type == MulticastMessageType::PARTICIPANT_REGISTER) {
+        if (this->compression_threshold_ > 0) ack.set_compressed();
+        size_t max_batch_size = std::max(this->shards_.front()->delivery_pool.options().batch_max_bytes, (size_t)DeliveryPool::REPLAY_WRITE_SIZE);
+        ack << std::to_string(this->compression_threshold_) + " " + std::to_string(this->max_frame_size_) + " " + std::to_string(max_batch_size);
+    }
+    if (header.type == MulticastMessageType::PARTICIPANT_STATS) {
+        ack << metrics().report() + this->backlogReport();
+    }
+    return ack;
+}
+
+bool Coordinator::flushSession(Session &session) {
+    if (session.outbound.empty()) return true;
+
+    TransferInfo result = session.socket.try_send(Buffer(&session.outbound[0], session.outbound.size()));
+    session.outbound.erase(0, result.bytes);
+
+    return !result.closed;
+}
+
+void Coordinator::receiveShardMessages(Shard &shard) {
+    ShardMessage message;
+    for (size_t source = 0; source < shard.inbound.size(); source++) {
+        while (shard.inbound[source]->try_pop(message)) {
+            switch (message.kind) {
+                case (ShardMessage::Kind::REQUEST): {
+                    MulticastMessage part_req(message.header.type, message.header.pid, message.header.coordinator_time);
+                    part_req << std::move(message.body);
+                    if (message.header.flags & HEADER_FLAG_COMPRESSED) part_req.set_compressed();
+                    if (message.header.flags & HEADER_FLAG_GROUP) part_req.set_group(message.header.group);
+                    part_req.set_chunk_flags(message.header.flags);
+                    this->handleRequest(shard, part_req, message.part_ip);
+                    if (message.session == NO_SESSION) break;
+
+                    ShardMessage ack;
+                    ack.kind = ShardMessage::Kind::ACKNOWLEDGE;
+                    ack.header = message.header;
+                    ack.session = message.session;
+                    this->sendShardMessage(shard, source, std::move(ack));
+                    break;
+                }
+                case (ShardMessage::Kind::ACKNOWLEDGE): {
+                    // The participant may have hung up while its request was being handled
+                    auto entry = shard.sessions.find(message.session);
+                    if (entry == shard.sessions.end()) break;
+
+                    Session &session = *entry->second;
+                    MulticastMessage ack = this->acknowledge(message.header);
+                    ack.append_to(session.outbound);
+                    if (!this->flushSession(session)) {
+                        shard.event_loop.do_remove(session.socket);
+                        shard.sessions.erase(entry);
+                    }
+                    break;
+                }
+                case (ShardMessage::Kind::MULTICAST): {
+                    this->deliverMulticast(shard, std::move(message.frame), message.arrival_time, message.group, message.sequence);
+                    break;
+                }
+            }
         }
-        else {
-            MulticastMessage ack(MulticastMessageType::NEGATIVE_ACKNOWLEDGEMENT, part_req.header().pid, std::time(0));
-            part_socket.do_sendall(ack.to_buffer());
-            return;
+    }
+}
+
+void Coordinator::sendShardMessage(Shard &shard, size_t target, ShardMessage message) {
+    // Messages that are already waiting go first, so that the order between two shards is kept
+    std::deque<ShardMessage> &overflow = shard.overflow[target];
+    if (!overflow.empty() || !this->shards_[target]->inbound[shard.index]->try_push(std::move(message))) {
+        overflow.push_back(std::move(message));
+    }
+    shard.pending_wakes[target] = true;
+}
+
+bool Coordinator::flushShardMessages(Shard &shard) {
+    bool retry_pending = false;
+    for (size_t target = 0; target < this->shards_.size(); target++) {
+        std::deque<ShardMessage> &overflow = shard.overflow[target];
+        SpscQueue<ShardMessage> &queue = *this->shards_[target]->inbound[shard.index];
+        while (!overflow.empty() && queue.try_push(std::move(overflow.front()))) {
+            overflow.pop_front();
+        }
+        retry_pending = retry_pending || !overflow.empty();
+
+        if (shard.pending_wakes[target]) {
+            this->shards_[target]->event_loop.do_wake();
+            shard.pending_wakes[target] = false;
         }
     }
+
+    return retry_pending;
 }
 
-void Coordinator::handleRequest(MulticastMessage part_req, std::string part_ip) {
+Coordinator::Shard &Coordinator::owner(uint16_t pid) {
+    return *this->shards_[pid % this->shards_.size()];
+}
+
+void Coordinator::handleRequest(Shard &shard, MulticastMessage &part_req, std::string part_ip) {
+    if (Counter *handled = requests_handled[(size_t)part_req.header().type]) handled->add();
     switch(part_req.header().type) {
         case(MulticastMessageType::PARTICIPANT_REGISTER): {
-            this->handleRegister(part_req, part_ip);
+            this->handleRegister(shard, part_req, part_ip);
             break;
         };
         case(MulticastMessageType::PARTICIPANT_DEREGISTER): {
-            this->handleDeregister(part_req);
+            this->handleDeregister(shard, part_req);
             break;
         };
         case(MulticastMessageType::PARTICIPANT_RECONNECT): {
-            this->handleReconnect(part_req);
+            this->handleReconnect(shard, part_req);
             break;
         };
         case(MulticastMessageType::PARTICIPANT_DISCONNECT): {
-            this->handleDisconnect(part_req);
+            this->handleDisconnect(shard, part_req);
             break;
         };
         case(MulticastMessageType::PARTICIPANT_MSEND): {
-            this->handleMSend(part_req);
+            this->handleMSend(shard, part_req);
+            break;
+        }
+        case(MulticastMessageType::PARTICIPANT_SUBSCRIBE): {
+            this->handleSubscribe(shard, part_req);
+            break;
+        }
+        case(MulticastMessageType::PARTICIPANT_UNSUBSCRIBE): {
+            this->handleUnsubscribe(shard, part_req);
             break;
         }
         default: {
@@ -110,75 +669,237 @@ void Coordinator::handleRequest(MulticastMessage part_req, std::string part_ip)
     }
 }
 
-void Coordinator::handleRegister(MulticastMessage part_req, std::string part_ip) {
-    this->pids_registered_.insert({part_req.header().pid, part_ip});
-    this->pids_connected_.insert({part_req.header().pid, stoi(part_req.body())});
+void Coordinator::handleRegister(Shard &shard, MulticastMessage &part_req, std::string part_ip) {
+    uint16_t pid = part_req.header().pid;
+    if (shard.members.state(pid) == MemberState::DISCONNECTED || shard.spilling.erase(pid) > 0) {
+        shard.message_log.close_cursor(pid);
+    }
+    // Registering starts the participant over, with no subscriptions
+    this->dropSubscriptions(shard, pid);
+    shard.members.add(pid, part_ip, stoi(part_req.body()));
+    shard.delivery_pool.open(pid, part_ip, stoi(part_req.body()));
+    this->checkpointMember(shard, pid);
 }
 
-void Coordinator::handleDeregister(MulticastMessage part_req) {
-    this->pids_registered_.erase(part_req.header().pid);
-    if (this->pids_disconnected_.count(part_req.header().pid) > 0) {
-        std::remove(this->pids_disconnected_.at(part_req.header().pid).c_str());
-        this->pids_disconnected_.erase(part_req.header().pid);
+void Coordinator::handleDeregister(Shard &shard, MulticastMessage &part_req) {
+    uint16_t pid = part_req.header().pid;
+    shard.delivery_pool.close(pid);
+    if (shard.members.state(pid) == MemberState::DISCONNECTED || shard.spilling.erase(pid) > 0) {
+        shard.message_log.close_cursor(pid);
     }
+    this->dropSubscriptions(shard, pid);
+    shard.members.remove(pid);
+    this->checkpointMember(shard, pid);
     return;
 }
 
-void Coordinator::handleReconnect(MulticastMessage part_req) {
-    // TODO: SEND ALL MESSAGES MISSED WHILE DISCONNECTED
-    // OPEN FILE, FOR EACH LINE, SEND MESSAGE
-    std::ifstream msgfile;
-    std::string file_path = pids_disconnected_.at(part_req.header().pid);
-    msgfile.open(file_path);
-    std::string msg_body;
-    uint16_t msg_pid;
-    time_t msg_time;
-    std::string line;
-    while (std::getline(msgfile, line)) {
-        std::istringstream iss(line);
-        iss >> msg_body >> msg_pid >> msg_time;
-        if (difftime(msg_time, disconnect_times.at(part_req.header().pid)) <= this->persistence_time_) {
-            MulticastMessage missed_msg(MulticastMessageType::MULTI_MESSAGE, msg_pid, msg_time);
-            missed_msg << msg_body;
-            InternetSocket send_sock;
-            send_sock.do_connect(this->pids_registered_.at(part_req.header().pid), stoi(part_req.body()));
-            send_sock.do_sendall(missed_msg.to_buffer());
-        }
-    }
-    std::remove(file_path.c_str());
-    pids_disconnected_.erase(part_req.header().pid);
-    disconnect_times.erase(part_req.header().pid);
-    pids_connected_.insert({part_req.header().pid, stoi(part_req.body())});
+void Coordinator::handleReconnect(Shard &shard, MulticastMessage &part_req) {
+    TRACE_SPAN("coordinator.reconnect");
+    uint16_t pid = part_req.header().pid;
+    if (shard.members.state(pid) != MemberState::DISCONNECTED) return;
+    // The body holds the port to deliver to, optionally followed by the sequence number of the last
+    // message the participant saw, and then by that of the last message it saw of each named group
+    // as the group's id and sequence number separated by a colon
+    std::istringstream body(part_req.body());
+    int port = 0;
+    uint64_t last_seen = 0;
+    body >> port >> last_seen;
+    std::unordered_map<uint32_t, uint64_t> group_last_seen;
+    std::string group_entry;
+    while (body >> group_entry) {
+        size_t colon = group_entry.find(':');
+        if (colon == std::string::npos) continue;
+        group_last_seen[std::strtoul(group_entry.c_str(), nullptr, 10)] = std::strtoull(group_entry.c_str() + colon + 1, nullptr, 10);
+    }
+    // Missed messages are replayed over the same connection that later messages will be sent on,
+    // by a delivery worker, so that they arrive before anything multicast after this point
+    shard.delivery_pool.open(pid, shard.members.ip(pid), port);
+    // Resume right after the last message the participant has, so nothing is sent to it twice, and
+    // stop where its persistence window closed
+    this->replayCursor(shard, pid, shard.message_log, shard.message_log.seek(std::max(shard.members.sequence(pid), last_seen)));
+    // Each named group is replayed after that, in its own order
+    for (uint32_t group : shard.groups.groups(pid)) {
+        MessageLog &log = this->groupLog(shard, group);
+        this->replayCursor(shard, pid, log, log.seek(std::max(shard.groups.sequence(group, pid), group_last_seen[group])));
+    }
+    shard.members.connect(pid, port);
+    this->checkpointMember(shard, pid);
     return;
 }
 
-void Coordinator::handleDisconnect(MulticastMessage part_req) {
-    disconnect_times.insert({part_req.header().pid, std::time(0)});
-    pids_connected_.erase(part_req.header().pid);
-    std::string file_path = std::to_string(part_req.header().pid) + "_missed_msgs.txt";
-    std::ofstream outfile(file_path);
-    outfile.close();
-    this->pids_disconnected_.insert({part_req.header().pid, file_path});
+void Coordinator::handleDisconnect(Shard &shard, MulticastMessage &part_req) {
+    uint16_t pid = part_req.header().pid;
+    if (shard.members.state(pid) != MemberState::CONNECTED) return;
+    time_t disconnect_time = std::time(0);
+    shard.delivery_pool.close(pid);
+    // A participant that fell behind already has a cursor from the first message it did not get
+    auto spilled = shard.spilling.find(pid);
+    if (spilled != shard.spilling.end()) {
+        shard.members.disconnect(pid, disconnect_time, spilled->second - 1);
+        shard.spilling.erase(spilled);
+        this->checkpointMember(shard, pid);
+        return;
+    }
+    // Everything appended to the log from now on until the persistence window closes was missed by
+    // this participant
+    shard.message_log.open_cursor(pid, disconnect_time + this->persistence_time_);
+    for (uint32_t group : shard.groups.groups(pid)) {
+        this->groupLog(shard, group).open_cursor(pid, disconnect_time + this->persistence_time_);
+        shard.groups.set_sequence(group, pid, shard.group_sequences[group]);
+    }
+    shard.members.disconnect(pid, disconnect_time, shard.last_sequence);
+    this->checkpointMember(shard, pid);
     return;
 }
 
-void Coordinator::handleMSend(MulticastMessage part_req) {
-    // Send message to all who are connected
-    for (auto [key, val] : this->pids_connected_) {
-        InternetSocket send_sock;
-        send_sock.do_connect(this->pids_registered_.at(key), val);
-        MulticastMessage tempMessage(MulticastMessageType::MULTI_MESSAGE, part_req.header().pid, part_req.header().coordinator_time);
-        tempMessage << part_req.body();
-        send_sock.do_sendall(tempMessage.to_buffer());
-        send_sock.do_shutdown();
-    }
-    std::cout << "[Message Sent to Group] " << part_req.body() << "\n";
-    // Store message in map for those who are disconnected
-    for (auto [key, val]: this->pids_disconnected_) {
-        std::ofstream fileout;
-        fileout.open(val, std::ios_base::app);
-        fileout << part_req.body() << " " << part_req.header().pid << " " << part_req.header().coordinator_time << "\n";
-        fileout.close();
+void Coordinator::handleMSend(Shard &shard, MulticastMessage &part_req) {
+    TRACE_SPAN("coordinator.msend");
+    // Messages are stamped with the time they arrived here, which is what persistence windows and
+    // expiry are measured against
+    time_t arrival_time = std::time(0);
+    // Only the sequencer handles msends, so numbering them here puts them in one order for everyone.
+    // Each named group is numbered on its own, so that its subscribers can tell when they missed
+    // some of its messages
+    uint32_t group = part_req.header().group;
+    uint64_t sequence = (group == 0 ? shard.last_sequence : shard.group_sequences[group]) + 1;
+    MulticastMessage multi_msg(MulticastMessageType::MULTI_MESSAGE, part_req.header().pid, arrival_time);
+    multi_msg.set_sequence(sequence);
+    if (group != 0) multi_msg.set_group(group);
+    multi_msg << part_req.take_body();
+    // Compressed bodies are passed on as they are, and only ever decompressed by the recipients
+    bool compressed = part_req.header().flags & HEADER_FLAG_COMPRESSED;
+    if (compressed) multi_msg.set_compressed();
+    // Chunks are forwarded as soon as they arrive, and only ever put back together by the recipients
+    bool chunked = part_req.header().flags & (HEADER_FLAG_MORE_CHUNKS | HEADER_FLAG_CONTINUATION);
+    multi_msg.set_chunk_flags(part_req.header().flags);
+    msend_bytes.add(multi_msg.header().size);
+    {
+        ScopedTimer fanout_timer(msend_fanout_time);
+        TRACE_SPAN("coordinator.msend.fanout");
+        // The message is serialized once, and every shard, recipient and log share that one copy
+        Buffer frame = multi_msg.to_shared_buffer();
+        for (size_t target = 0; target < this->shards_.size(); target++) {
+            if (target == shard.index) continue;
+            ShardMessage multicast;
+            multicast.kind = ShardMessage::Kind::MULTICAST;
+            multicast.frame = frame.share();
+            multicast.arrival_time = arrival_time;
+            multicast.group = group;
+            multicast.sequence = sequence;
+            this->sendShardMessage(shard, target, std::move(multicast));
+        }
+        this->deliverMulticast(shard, std::move(frame), arrival_time, group, sequence);
+    }
+    std::string group_name = group == 0 ? "" : this->groupName(group);
+    std::string recipients = group == 0 ? "Group" : "Group " + (group_name.empty() ? "#" + std::to_string(group) : group_name);
+    if (compressed || chunked) {
+        std::cout << "[Message Sent to " << recipients << "] (" << multi_msg.header().size << (compressed ? " compressed" : "") << " bytes" << (chunked ? " of a chunked message" : "") << ")\n";
+    } else {
+        std::cout << "[Message Sent to " << recipients << "] " << multi_msg.body() << "\n";
     }
     return;
-}
\ No newline at end of file
+}
+
+void Coordinator::handleSubscribe(Shard &shard, MulticastMessage &part_req) {
+    uint16_t pid = part_req.header().pid;
+    if (shard.members.state(pid) == MemberState::UNREGISTERED) return;
+    uint32_t group = group_id(part_req.body());
+    if (!shard.groups.subscribe(group, pid)) return;
+    MessageLog &log = this->groupLog(shard, group);
+    // A participant whose messages are being stored from its cursor on gets the group's stored as
+    // well, until the same window closes
+    MessageLog::Cursor cursor;
+    if (shard.message_log.find_cursor(pid, cursor)) {
+        log.open_cursor(pid, cursor.expires_at);
+        shard.groups.set_sequence(group, pid, shard.group_sequences[group]);
+    }
+    this->checkpointMember(shard, pid);
+    std::cout << "[Coordinator Message] Participant #" << pid << " subscribed to group " << part_req.body() << "\n";
+    return;
+}
+
+void Coordinator::handleUnsubscribe(Shard &shard, MulticastMessage &part_req) {
+    uint16_t pid = part_req.header().pid;
+    uint32_t group = group_id(part_req.body());
+    if (!shard.groups.unsubscribe(group, pid)) return;
+    this->groupLog(shard, group).close_cursor(pid);
+    this->checkpointMember(shard, pid);
+    std::cout << "[Coordinator Message] Participant #" << pid << " unsubscribed from group " << part_req.body() << "\n";
+    return;
+}
+
+void Coordinator::deliverMulticast(Shard &shard, Buffer frame, time_t arrival_time, uint32_t group, uint64_t sequence) {
+    if (group != 0) {
+        shard.group_sequences[group] = sequence;
+        shard.checkpoint.set_group_sequence(group, sequence);
+        if (!shard.spilling.empty()) this->resumeSpilled(shard);
+        // Only the group's subscribers are looked at, however many participants the shard owns, and
+        // the message is stored once if any of them is not receiving messages right now
+        bool store = false;
+        for (uint16_t pid : shard.groups.subscribers(group)) {
+            MemberState state = shard.members.state(pid);
+            if (state == MemberState::DISCONNECTED || (!shard.spilling.empty() && shard.spilling.count(pid) > 0)) {
+                store = true;
+                continue;
+            }
+            if (state != MemberState::CONNECTED || shard.delivery_pool.deliver(pid, frame.share())) continue;
+            this->handleOverflow(shard, pid, group, sequence);
+            store = true;
+        }
+        if (store) this->groupLog(shard, group).append(frame, arrival_time, sequence);
+        return;
+    }
+    shard.last_sequence = sequence;
+    shard.checkpoint.set_last_sequence(sequence);
+    // Participants that caught up get what was stored for them before anything new
+    if (!shard.spilling.empty()) this->resumeSpilled(shard);
+    // Queue the message for everyone who is connected, the delivery workers send it from there
+    // The list is walked from the back since an overflow may disconnect the participant being visited
+    const std::vector<uint16_t> &recipients = shard.members.connected();
+    for (size_t i = recipients.size(); i-- > 0;) {
+        uint16_t pid = recipients[i];
+        if (!shard.spilling.empty() && shard.spilling.count(pid) > 0) continue;
+        if (!shard.delivery_pool.deliver(pid, frame.share())) this->handleOverflow(shard, pid, 0, sequence);
+    }
+    // Store the message once for everyone who is disconnected or spilling and whose window is still
+    // open
+    if (shard.members.disconnected_count() > 0 || !shard.spilling.empty()) {
+        shard.message_log.append(frame, arrival_time, sequence);
+    }
+}
+
+MessageLog &Coordinator::groupLog(Shard &shard, uint32_t group) {
+    auto entry = shard.group_logs.find(group);
+    if (entry != shard.group_logs.end()) return *entry->second;
+    std::unique_ptr<MessageLog> log = std::make_unique<MessageLog>(shard.log_directory + "/group_" + std::to_string(group));
+    std::lock_guard<std::mutex> lock(shard.group_logs_lock);
+    return *shard.group_logs.emplace(group, std::move(log)).first->second;
+}
+
+void Coordinator::replayCursor(Shard &shard, uint16_t pid, MessageLog &log, uint64_t from) {
+    uint64_t to = log.cursor_end(pid);
+    uint64_t hold = log.retain(from, to);
+    log.close_cursor(pid);
+    shard.delivery_pool.replay(pid, log, from, to, hold);
+}
+
+void Coordinator::dropSubscriptions(Shard &shard, uint16_t pid) {
+    // Unsubscribing changes the list of groups being walked, so walk a copy
+    std::vector<uint32_t> groups = shard.groups.groups(pid);
+    for (uint32_t group : groups) {
+        shard.groups.unsubscribe(group, pid);
+        this->groupLog(shard, group).close_cursor(pid);
+    }
+}
+
+bool Coordinator::claimGroupName(uint32_t id, const std::string &name) {
+    std::lock_guard<std::mutex> lock(this->group_names_lock_);
+    auto entry = this->group_names_.emplace(id, name).first;
+    return entry->second == name;
+}
+
+std::string Coordinator::groupName(uint32_t id) {
+    std::lock_guard<std::mutex> lock(this->group_names_lock_);
+    auto entry = this->group_names_.find(id);
+    return entry != this->group_names_.end() ? entry->second : "";
+}
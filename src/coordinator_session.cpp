@@ -0,0 +1,140 @@
+// File: coordinator_session.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/coordinator_session.hpp"
+#include "include/frame_reader.hpp"
+#include "include/metrics.hpp"
+
+#include <algorithm>
+#include <future>
+
+// How long the coordinator takes to answer a request, from when it is sent until its answer is read
+static Histogram &request_time = metrics().histogram("session.request_ns");
+
+// CoordinatorSession Public API Functions ---------------------------------------------------------
+
+CoordinatorSession::CoordinatorSession(std::string address, uint16_t port, size_t window) :
+    address_(address),
+    port_(port),
+    window_(std::max<size_t>(window, 1)),
+    connected_(false),
+    next_request_id_(1) {}
+
+CoordinatorSession::~CoordinatorSession() { close(); }
+
+Reply CoordinatorSession::request(MulticastMessage request) {
+    std::promise<Reply> answer;
+    std::future<Reply> reply = answer.get_future();
+    send_(request, [&answer](const Reply &result) { answer.set_value(result); });
+
+    return reply.get();
+}
+
+void CoordinatorSession::send(MulticastMessage request,
+                              std::function<void(const Reply &)> on_reply) {
+    send_(request, std::move(on_reply));
+}
+
+void CoordinatorSession::drain() {
+    std::unique_lock<std::mutex> lock(lock_);
+    answered_.wait(lock, [this] { return pending_.empty(); });
+}
+
+void CoordinatorSession::close() {
+    drain();
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        // Closing the write end tells the coordinator that no more requests are coming, so it
+        // closes its end too, which is what stops the reader
+        if (connected_) socket_.do_shutdown();
+    }
+    if (reader_.joinable()) reader_.join();
+}
+
+// CoordinatorSession Private API Functions --------------------------------------------------------
+
+void CoordinatorSession::send_(MulticastMessage &request,
+                               std::function<void(const Reply &)> on_reply) {
+    MulticastMessageHeader header = request.header();
+    bool tagged = header.type != MulticastMessageType::PARTICIPANT_REGISTER
+                  && header.version >= REQUEST_ID_VERSION;
+
+    std::unique_lock<std::mutex> lock(lock_);
+    answered_.wait(lock, [this, tagged] {
+        return tagged ? pending_.size() < window_ && pending_.count(0) == 0 : pending_.empty();
+    });
+    connect_();
+
+    uint32_t request_id = 0;
+    if (tagged) {
+        request_id = next_request_id_++;
+        if (next_request_id_ == 0) next_request_id_ = 1;
+        request.set_request_id(request_id);
+    }
+    pending_[request_id] = Pending {std::move(on_reply), std::chrono::steady_clock::now()};
+    lock.unlock();
+
+    // If the connection broke, the reader sees it close and answers every request in flight
+    socket_.try_sendv(request.to_buffers());
+}
+
+void CoordinatorSession::connect_() {
+    if (connected_) return;
+
+    // The reader of the previous connection has already seen it close, so it is about to exit
+    if (reader_.joinable()) reader_.join();
+
+    socket_ = InternetSocket();
+    socket_.do_connect(address_, port_);
+    socket_.do_set_nodelay();
+    connected_ = true;
+    reader_    = std::thread(&CoordinatorSession::read_replies_, this);
+}
+
+void CoordinatorSession::read_replies_() {
+    FrameReader reply_reader(FrameReader::DEFAULT_READ_SIZE, MAX_REPLY_SIZE);
+    MulticastMessageHeader header;
+    Buffer body(nullptr, 0);
+
+    while (reply_reader.fill(socket_)) {
+        while (reply_reader.next(header, body)) {
+            uint32_t request_id = (header.flags & HEADER_FLAG_REQUEST_ID) ? header.request_id : 0;
+
+            std::function<void(const Reply &)> on_reply;
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                auto handler = pending_.find(request_id);
+                if (handler == pending_.end()) continue;
+                on_reply = std::move(handler->second.on_reply);
+                request_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now() - handler->second.sent_at)
+                                        .count());
+            }
+
+            // The request stays in flight until its handler is done, so `drain` also waits for it
+            on_reply(Reply {header, std::string((char *)body.data(), body.size())});
+
+            std::lock_guard<std::mutex> lock(lock_);
+            pending_.erase(request_id);
+            answered_.notify_all();
+        }
+        // An answer larger than any the coordinator sends is never received, so the connection is
+        // dropped and every request in flight fails
+        if (reply_reader.oversized()) {
+            socket_.do_shutdown();
+            break;
+        }
+    }
+
+    // Nothing that is still in flight will be answered on this connection
+    std::unordered_map<uint32_t, Pending> unanswered;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        unanswered.swap(pending_);
+        connected_ = false;
+    }
+    for (auto &handler : unanswered) handler.second.on_reply(Reply());
+
+    answered_.notify_all();
+}
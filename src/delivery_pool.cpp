@@ -0,0 +1,457 @@
+// File: delivery_pool.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/delivery_pool.hpp"
+#include "include/metrics.hpp"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+// What the delivery pools of every shard have done
+static Counter &frames_dropped    = metrics().counter("delivery.frames_dropped");
+static Histogram &mailbox_wait    = metrics().histogram("delivery.mailbox_wait_ns");
+static Counter &replayed_messages = metrics().counter("delivery.replayed_messages");
+static Counter &replayed_bytes    = metrics().counter("delivery.replayed_bytes");
+static Histogram &replay_time     = metrics().histogram("delivery.replay_ns");
+
+// DeliveryPool Public API Functions ---------------------------------------------------------------
+
+DeliveryPool::DeliveryPool(DeliveryOptions options) :
+    options_(options), connection_pool_(options.send_timeout), stopping_(false) {
+    size_t worker_count = std::max<size_t>(options_.workers, 1);
+
+    for (size_t i = 0; i < worker_count; i++) queues_.push_back(std::make_unique<WorkerQueue>());
+    for (size_t i = 0; i < worker_count; i++) workers_.emplace_back(&DeliveryPool::work_, this, i);
+}
+
+DeliveryPool::~DeliveryPool() {
+    stop();
+    for (std::thread &worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void DeliveryPool::open(uint16_t pid, std::string ip, uint16_t port) {
+    // A participant that connects again is reading again
+    {
+        Mailbox *mailbox = mailbox_(pid);
+        std::lock_guard<std::mutex> lock(mailbox->lock);
+        mailbox->stalled = false;
+    }
+
+    DeliveryJob job;
+    job.kind = DeliveryJob::Kind::OPEN;
+    job.ip   = ip;
+    job.port = port;
+    submit_(pid, std::move(job));
+}
+
+bool DeliveryPool::deliver(uint16_t pid, Buffer frame) {
+    DeliveryJob job;
+    job.kind  = DeliveryJob::Kind::SEND;
+    job.frame = std::move(frame);
+    return submit_(pid, std::move(job));
+}
+
+void DeliveryPool::evict(uint16_t pid, Buffer notice) {
+    // The notice rides on the CLOSE job, so it is never held to the limits or coalesced into a batch
+    DeliveryJob job;
+    job.kind  = DeliveryJob::Kind::CLOSE;
+    job.frame = std::move(notice);
+    submit_(pid, std::move(job));
+}
+
+MailboxDepth DeliveryPool::depth(uint16_t pid) {
+    Mailbox *mailbox = mailbox_(pid);
+    std::lock_guard<std::mutex> lock(mailbox->lock);
+
+    MailboxDepth result;
+    result.messages = mailbox->queued_messages + mailbox->sending_messages;
+    result.bytes    = mailbox->queued_bytes + mailbox->sending_bytes;
+    result.dropped  = mailbox->dropped;
+
+    return result;
+}
+
+std::map<uint16_t, MailboxDepth> DeliveryPool::depths() {
+    std::map<uint16_t, MailboxDepth> result;
+    std::lock_guard<std::mutex> lock(mailboxes_lock_);
+
+    for (auto &entry : mailboxes_) {
+        Mailbox &mailbox = *entry.second;
+        std::lock_guard<std::mutex> mailbox_lock(mailbox.lock);
+        if (mailbox.queued_messages + mailbox.sending_messages == 0 && mailbox.dropped == 0) continue;
+
+        MailboxDepth &depth = result[entry.first];
+        depth.messages      = mailbox.queued_messages + mailbox.sending_messages;
+        depth.bytes         = mailbox.queued_bytes + mailbox.sending_bytes;
+        depth.dropped       = mailbox.dropped;
+    }
+
+    return result;
+}
+
+bool DeliveryPool::caught_up(uint16_t pid) {
+    Mailbox *mailbox = mailbox_(pid);
+    std::lock_guard<std::mutex> lock(mailbox->lock);
+    if (mailbox->stalled && std::chrono::steady_clock::now() < mailbox->stalled_until) return false;
+
+    bool caught_up = mailbox->queued_messages + mailbox->sending_messages <= options_.mailbox_max_messages / 2
+                     && mailbox->queued_bytes + mailbox->sending_bytes <= options_.mailbox_max_bytes / 2;
+    if (caught_up) mailbox->stalled = false;
+
+    return caught_up;
+}
+
+void DeliveryPool::close(uint16_t pid) {
+    DeliveryJob job;
+    job.kind = DeliveryJob::Kind::CLOSE;
+    submit_(pid, std::move(job));
+}
+
+void DeliveryPool::replay(uint16_t pid, MessageLog &log, uint64_t from, uint64_t to,
+                          uint64_t hold) {
+    DeliveryJob job;
+    job.kind = DeliveryJob::Kind::REPLAY;
+    job.log  = &log;
+    job.from = from;
+    job.to   = to;
+    job.hold = hold;
+    submit_(pid, std::move(job));
+}
+
+const DeliveryOptions &DeliveryPool::options() const { return options_; }
+
+void DeliveryPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(idle_lock_);
+        stopping_ = true;
+    }
+    idle_cv_.notify_all();
+}
+
+// DeliveryPool Private API Functions --------------------------------------------------------------
+
+bool DeliveryPool::submit_(uint16_t pid, DeliveryJob job) {
+    Mailbox *mailbox = mailbox_(pid);
+    job.queued_at    = std::chrono::steady_clock::now();
+
+    bool needs_scheduling = false;
+    {
+        std::lock_guard<std::mutex> lock(mailbox->lock);
+        if (job.kind == DeliveryJob::Kind::SEND) {
+            if (!make_room_(*mailbox, job.frame.size())) return false;
+            mailbox->queued_messages++;
+            mailbox->queued_bytes += job.frame.size();
+        }
+        mailbox->jobs.push_back(std::move(job));
+        needs_scheduling   = !mailbox->scheduled;
+        mailbox->scheduled = true;
+    }
+
+    // An idle mailbox starts on the queue of the worker its pid maps to, so that a participant
+    // tends to be served by the same worker unless that worker falls behind and its work is stolen
+    if (needs_scheduling) schedule_(mailbox, pid % queues_.size());
+
+    return true;
+}
+
+bool DeliveryPool::make_room_(Mailbox &mailbox, size_t frame_size) {
+    // A participant that stopped reading is treated as if its mailbox were full
+    if (mailbox.stalled) return false;
+
+    auto full = [&]() {
+        return mailbox.queued_messages + 1 > options_.mailbox_max_messages
+               || mailbox.queued_bytes + frame_size > options_.mailbox_max_bytes;
+    };
+    if (!full()) return true;
+    if (options_.overflow_policy != OverflowPolicy::DROP_OLDEST) return false;
+
+    // Only frames can be dropped, every other job still has to run in order
+    for (auto job = mailbox.jobs.begin(); job != mailbox.jobs.end() && full();) {
+        if (job->kind != DeliveryJob::Kind::SEND) {
+            job++;
+            continue;
+        }
+        mailbox.queued_messages--;
+        mailbox.queued_bytes -= job->frame.size();
+        mailbox.dropped++;
+        frames_dropped.add();
+        job = mailbox.jobs.erase(job);
+    }
+
+    return true;
+}
+
+DeliveryPool::Mailbox *DeliveryPool::mailbox_(uint16_t pid) {
+    std::lock_guard<std::mutex> lock(mailboxes_lock_);
+
+    std::unique_ptr<Mailbox> &mailbox = mailboxes_[pid];
+    if (mailbox == nullptr) {
+        mailbox = std::make_unique<Mailbox>(pid, options_.batch_max_bytes);
+    }
+
+    return mailbox.get();
+}
+
+void DeliveryPool::schedule_(Mailbox *mailbox, size_t worker) {
+    {
+        std::lock_guard<std::mutex> lock(idle_lock_);
+        ready_count_++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[worker]->lock);
+        queues_[worker]->ready.push_back(mailbox);
+    }
+    idle_cv_.notify_one();
+}
+
+DeliveryPool::Mailbox *DeliveryPool::take_(size_t worker) {
+    while (true) {
+        Mailbox *mailbox = nullptr;
+
+        // Take the oldest mailbox from this worker's own queue
+        {
+            std::lock_guard<std::mutex> lock(queues_[worker]->lock);
+            if (!queues_[worker]->ready.empty()) {
+                mailbox = queues_[worker]->ready.front();
+                queues_[worker]->ready.pop_front();
+            }
+        }
+
+        // Otherwise steal the newest mailbox from another worker's queue
+        for (size_t i = 1; mailbox == nullptr && i < queues_.size(); i++) {
+            WorkerQueue &victim = *queues_[(worker + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (!victim.ready.empty()) {
+                mailbox = victim.ready.back();
+                victim.ready.pop_back();
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(idle_lock_);
+        if (mailbox != nullptr) {
+            ready_count_--;
+            return mailbox;
+        }
+
+        idle_cv_.wait(lock, [this] { return ready_count_ > 0 || stopping_; });
+        if (stopping_) return nullptr;
+    }
+}
+
+void DeliveryPool::run_(Mailbox *mailbox, size_t worker) {
+    // Frames that are taken out of the mailbox still count towards its depth until they are sent
+    auto take_jobs = [mailbox](std::deque<DeliveryJob> &jobs) {
+        if (jobs.empty()) {
+            jobs.swap(mailbox->jobs);
+        } else {
+            std::move(mailbox->jobs.begin(), mailbox->jobs.end(), std::back_inserter(jobs));
+            mailbox->jobs.clear();
+        }
+        mailbox->sending_messages += mailbox->queued_messages;
+        mailbox->sending_bytes += mailbox->queued_bytes;
+        mailbox->queued_messages = 0;
+        mailbox->queued_bytes    = 0;
+    };
+
+    std::deque<DeliveryJob> &jobs = mailbox->running;
+    {
+        std::lock_guard<std::mutex> lock(mailbox->lock);
+        take_jobs(jobs);
+    }
+
+    // A short run of messages waits out the linger budget of its oldest message for more messages
+    // to coalesce with
+    size_t pending_bytes = 0;
+    for (DeliveryJob &job : jobs) pending_bytes += job.frame.size();
+
+    if (options_.batch_linger.count() > 0 && jobs.front().kind == DeliveryJob::Kind::SEND
+        && pending_bytes < options_.batch_max_bytes) {
+        std::this_thread::sleep_until(jobs.front().queued_at + options_.batch_linger);
+
+        std::lock_guard<std::mutex> lock(mailbox->lock);
+        take_jobs(jobs);
+    }
+
+    run_jobs_(*mailbox);
+    jobs.clear();
+
+    bool needs_scheduling = false;
+    {
+        std::lock_guard<std::mutex> lock(mailbox->lock);
+        mailbox->sending_messages = 0;
+        mailbox->sending_bytes    = 0;
+        needs_scheduling   = !mailbox->jobs.empty();
+        mailbox->scheduled = needs_scheduling;
+    }
+
+    // Jobs that were queued while this mailbox ran go to the back of this worker's queue, so that
+    // other mailboxes get their turn first
+    if (needs_scheduling) schedule_(mailbox, worker);
+}
+
+void DeliveryPool::run_jobs_(Mailbox &mailbox) {
+    uint16_t pid                = mailbox.pid;
+    MulticastBatch &batch       = mailbox.batch;
+    DeliveryJob *first_in_batch = nullptr;
+    auto started                = std::chrono::steady_clock::now();
+
+    bool timed_out = false;
+    {
+        std::lock_guard<std::mutex> lock(mailbox.lock);
+        timed_out = mailbox.stalled;
+    }
+    uint64_t dropped = 0;
+    auto sent        = [&](SendResult result) { timed_out = timed_out || result == SendResult::TIMED_OUT; };
+
+    for (DeliveryJob &job : mailbox.running) {
+        if (job.kind == DeliveryJob::Kind::SEND) {
+            mailbox_wait.record(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(started - job.queued_at).count());
+        }
+        // Anything that cannot join the current batch sends it first, keeping every job in order
+        if (job.kind != DeliveryJob::Kind::SEND || !batch.fits(job.frame.size())) {
+            if (batch.count() > 0) sent(send_batch_(pid, batch, first_in_batch));
+        }
+        // Frames for a participant that stopped reading would only wait out the timeout again
+        if (timed_out && job.kind == DeliveryJob::Kind::SEND) {
+            dropped++;
+            continue;
+        }
+        if (job.kind != DeliveryJob::Kind::SEND || !batch.fits(job.frame.size())) {
+            sent(run_job_(pid, job));
+            continue;
+        }
+
+        if (batch.count() == 0) first_in_batch = &job;
+        batch.add(job.frame.data(), job.frame.size());
+    }
+
+    if (batch.count() > 0) sent(send_batch_(pid, batch, first_in_batch));
+    if (!timed_out) return;
+
+    // Unless the oldest messages are simply dropped, the participant is left to the overflow policy
+    // as if its mailbox were full
+    std::lock_guard<std::mutex> lock(mailbox.lock);
+    mailbox.dropped += dropped;
+    frames_dropped.add(dropped);
+    if (!mailbox.stalled && options_.overflow_policy != OverflowPolicy::DROP_OLDEST) {
+        mailbox.stalled       = true;
+        mailbox.stalled_until = std::chrono::steady_clock::now() + options_.send_timeout;
+        std::cout << "[Coordinator Message] Participant #" + std::to_string(pid)
+                         + " stopped reading, dropped " + std::to_string(dropped)
+                         + " messages that were waiting for it\n";
+    }
+}
+
+SendResult DeliveryPool::send_batch_(uint16_t pid, MulticastBatch &batch, DeliveryJob *single) {
+    TRACE_SPAN("delivery.send_batch");
+    // A batch of one would only add overhead, so its frame is sent as is
+    SendResult result = SendResult::SENT;
+    if (batch.count() == 1) {
+        result = run_job_(pid, *single);
+    } else {
+        result = connection_pool_.sendv(pid, batch.to_buffers());
+        if (result != SendResult::SENT) {
+            std::cout << "[Coordinator Message] Could not deliver " + std::to_string(batch.count())
+                             + " messages to participant #" + std::to_string(pid) + "\n";
+        }
+    }
+
+    batch.clear();
+    return result;
+}
+
+SendResult DeliveryPool::run_job_(uint16_t pid, DeliveryJob &job) {
+    SendResult result = SendResult::SENT;
+    switch (job.kind) {
+        case DeliveryJob::Kind::OPEN: {
+            connection_pool_.open(pid, job.ip, job.port);
+            break;
+        }
+        case DeliveryJob::Kind::SEND: {
+            result = connection_pool_.send(pid, job.frame);
+            if (result != SendResult::SENT) {
+                std::cout << "[Coordinator Message] Could not deliver message to participant #"
+                                 + std::to_string(pid) + "\n";
+            }
+            break;
+        }
+        case DeliveryJob::Kind::CLOSE: {
+            if (job.frame.size() > 0) connection_pool_.send(pid, job.frame);
+            connection_pool_.close(pid);
+            break;
+        }
+        case DeliveryJob::Kind::REPLAY: {
+            result = replay_(pid, job);
+            break;
+        }
+    }
+
+    return result;
+}
+
+SendResult DeliveryPool::replay_(uint16_t pid, DeliveryJob &job) {
+    TRACE_SPAN("delivery.replay");
+    auto start = std::chrono::steady_clock::now();
+
+    // Frames are gathered into large batches of views into the log, so that a long backlog goes out
+    // in few writes without being copied
+    MulticastBatch batch(REPLAY_WRITE_SIZE);
+    size_t messages = 0;
+    size_t bytes      = 0;
+    SendResult result = SendResult::SENT;
+
+    auto flush = [&]() {
+        if (batch.count() > 0 && result == SendResult::SENT) {
+            result = connection_pool_.sendv(pid, batch.to_buffers());
+        }
+        batch.clear();
+    };
+
+    // The range ends where the participant's persistence window closed, so every frame in it is due
+    job.log->read(job.from, job.to, [&](const char *frame, size_t size) {
+        if (!batch.fits(size)) flush();
+        if (!batch.fits(size)) {
+            // A frame too large for any batch is sent straight out of the log
+            if (result == SendResult::SENT) result = connection_pool_.send(pid, Buffer((void *)frame, size));
+        } else {
+            // Records in the log are laid out just like batch entries, so runs of them go out as is
+            batch.add_entry(frame - FRAME_PREFIX_SIZE, FRAME_PREFIX_SIZE + size);
+        }
+        messages++;
+        bytes += size;
+    }, flush);
+    flush();
+
+    job.log->release(job.hold);
+
+    if (result != SendResult::SENT) {
+        std::cout << "[Coordinator Message] Could not replay missed messages to participant #"
+                         + std::to_string(pid) + "\n";
+        return result;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    replayed_messages.add(messages);
+    replayed_bytes.add(bytes);
+    replay_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    double megabytes                      = bytes / (1024.0 * 1024.0);
+    double throughput = (elapsed.count() > 0) ? megabytes / elapsed.count() : 0.0;
+
+    std::cout << "[Coordinator Message] Replayed " + std::to_string(messages)
+                     + " missed messages (" + std::to_string(bytes) + " bytes) to participant #"
+                     + std::to_string(pid) + " in " + std::to_string(elapsed.count() * 1000.0)
+                     + " ms (" + std::to_string(throughput) + " MB/s)\n";
+
+    return result;
+}
+
+void DeliveryPool::work_(size_t worker) {
+    while (Mailbox *mailbox = take_(worker)) run_(mailbox, worker);
+}
@@ -0,0 +1,89 @@
+// File: event_loop.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/inet/event_loop.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+// The token that identifies the wake-up eventfd among the events returned by `epoll_wait()`
+static const uint64_t WAKE_TOKEN = std::numeric_limits<uint64_t>::max();
+
+// The most events that are collected by a single call to `epoll_wait()`
+static const int MAX_EVENTS = 256;
+
+void perror_and_exit(const char *header);
+
+// EventLoop Public API Functions ------------------------------------------------------------------
+
+EventLoop::EventLoop() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) perror_and_exit("epoll_create1() failed");
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) perror_and_exit("eventfd() failed");
+
+    epoll_event event;
+    event.events   = EPOLLIN;
+    event.data.u64 = WAKE_TOKEN;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0) {
+        perror_and_exit("epoll_ctl() failed");
+    }
+}
+
+EventLoop::~EventLoop() {
+    close(wake_fd_);
+    close(epoll_fd_);
+}
+
+void EventLoop::do_add(InternetSocket &socket, uint64_t token) {
+    epoll_event event;
+    event.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = token;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket.file_desc_, &event) < 0) {
+        perror_and_exit("epoll_ctl() failed");
+    }
+}
+
+void EventLoop::do_remove(InternetSocket &socket) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket.file_desc_, nullptr);
+}
+
+void EventLoop::do_wait(std::vector<LoopEvent> &events, int timeout) {
+    epoll_event ready[MAX_EVENTS];
+
+    events.clear();
+
+    int ready_fds = epoll_wait(epoll_fd_, ready, MAX_EVENTS, timeout);
+    if (ready_fds < 0 && errno == EINTR) return;
+    if (ready_fds < 0) perror_and_exit("epoll_wait() failed");
+
+    for (int i = 0; i < ready_fds; i++) {
+        if (ready[i].data.u64 == WAKE_TOKEN) {
+            // Drain the eventfd so that it does not keep waking this loop
+            uint64_t wakeups;
+            ssize_t bytes_read = read(wake_fd_, &wakeups, sizeof(wakeups));
+            (void)bytes_read;
+            continue;
+        }
+
+        LoopEvent event;
+        event.token     = ready[i].data.u64;
+        event.readable  = ready[i].events & (EPOLLIN | EPOLLRDHUP);
+        event.writeable = ready[i].events & EPOLLOUT;
+        event.closed    = ready[i].events & (EPOLLHUP | EPOLLERR);
+        events.push_back(event);
+    }
+}
+
+void EventLoop::do_wake() {
+    uint64_t wakeup    = 1;
+    ssize_t bytes_sent = write(wake_fd_, &wakeup, sizeof(wakeup));
+    (void)bytes_sent;
+}
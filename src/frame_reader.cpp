@@ -0,0 +1,93 @@
+// File: frame_reader.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/frame_reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// FrameReader Public API Functions ----------------------------------------------------------------
+
+FrameReader::FrameReader(size_t read_size, size_t max_frame_size) :
+    read_size_(std::max(read_size, MulticastMessageHeader::MAX_SIZE)),
+    max_frame_size_(max_frame_size),
+    begin_(0),
+    end_(0) {}
+
+bool FrameReader::next(MulticastMessageHeader &header, Buffer &body) {
+    if (oversized() || missing_() > 0) return false;
+
+    size_t header_size = MulticastMessageHeader::decode(
+        (const unsigned char *)&data_[begin_], end_ - begin_, header);
+    body = Buffer(&data_[begin_] + header_size, header.size);
+    begin_ += header_size + header.size;
+
+    return true;
+}
+
+bool FrameReader::oversized() const {
+    MulticastMessageHeader header;
+    size_t header_size = MulticastMessageHeader::decode(
+        (const unsigned char *)data_.data() + begin_, end_ - begin_, header);
+    if (header_size == 0) return false;
+
+    return header_size + header.size > max_frame_size_;
+}
+
+bool FrameReader::fill(InternetSocket &socket) {
+    reserve_();
+
+    Buffer free_space(&data_[end_], data_.size() - end_);
+    size_t bytes_recvd = socket.do_recv(free_space);
+    end_ += bytes_recvd;
+
+    return bytes_recvd > 0;
+}
+
+TransferInfo FrameReader::try_fill(InternetSocket &socket) {
+    reserve_();
+
+    Buffer free_space(&data_[end_], data_.size() - end_);
+    TransferInfo result = socket.try_recv(free_space);
+    end_ += result.bytes;
+
+    return result;
+}
+
+bool FrameReader::read(InternetSocket &socket, MulticastMessageHeader &header, Buffer &body) {
+    while (!next(header, body)) {
+        if (!fill(socket)) return false;
+    }
+
+    return true;
+}
+
+// FrameReader Private API Functions ---------------------------------------------------------------
+
+size_t FrameReader::missing_() const {
+    size_t buffered = end_ - begin_;
+    const unsigned char *data = (const unsigned char *)data_.data() + begin_;
+
+    // The fixed fields tell how large the rest of the header is
+    size_t header_size = MulticastMessageHeader::peek_size(data, buffered);
+    if (header_size == 0) return MulticastMessageHeader::BASE_SIZE - buffered;
+
+    MulticastMessageHeader header;
+    if (MulticastMessageHeader::decode(data, buffered, header) == 0) return header_size - buffered;
+
+    size_t frame_size = header_size + header.size;
+    return (buffered < frame_size) ? frame_size - buffered : 0;
+}
+
+void FrameReader::reserve_() {
+    // Everything before `begin_` has been handed out, so the unread bytes can be moved to the front
+    if (begin_ > 0) {
+        std::memmove(data_.data(), &data_[begin_], end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+
+    // An oversized frame is never handed out, so there is no point in making room for it
+    size_t wanted = end_ + std::max(read_size_, oversized() ? 0 : missing_());
+    if (data_.size() < wanted) data_.resize(wanted);
+}
@@ -0,0 +1,76 @@
+// File: group_table.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/group_table.hpp"
+
+#include <algorithm>
+
+// Removes `value` from `list`, whose order does not matter
+//
+// Returns false if `list` does not hold it
+template<typename T>
+static bool swap_remove(std::vector<T> &list, T value) {
+    auto position = std::find(list.begin(), list.end(), value);
+    if (position == list.end()) return false;
+
+    *position = list.back();
+    list.pop_back();
+
+    return true;
+}
+
+// GroupTable Public API Functions -----------------------------------------------------------------
+
+bool GroupTable::subscribe(uint32_t group, uint16_t pid) {
+    std::vector<uint32_t> &subscribed = subscriptions_[pid];
+    if (std::find(subscribed.begin(), subscribed.end(), group) != subscribed.end()) return false;
+
+    subscribed.push_back(group);
+    groups_[group].subscribers.push_back(pid);
+
+    return true;
+}
+
+bool GroupTable::unsubscribe(uint32_t group, uint16_t pid) {
+    auto subscribed = subscriptions_.find(pid);
+    if (subscribed == subscriptions_.end() || !swap_remove(subscribed->second, group)) return false;
+    if (subscribed->second.empty()) subscriptions_.erase(subscribed);
+
+    // Groups are dropped along with their last subscriber, so the table only grows with the
+    // subscriptions that exist
+    Group &entry = groups_[group];
+    swap_remove(entry.subscribers, pid);
+    entry.sequences.erase(pid);
+    if (entry.subscribers.empty()) groups_.erase(group);
+
+    return true;
+}
+
+const std::vector<uint16_t> &GroupTable::subscribers(uint32_t group) const {
+    static const std::vector<uint16_t> none;
+
+    auto entry = groups_.find(group);
+    return entry != groups_.end() ? entry->second.subscribers : none;
+}
+
+const std::vector<uint32_t> &GroupTable::groups(uint16_t pid) const {
+    static const std::vector<uint32_t> none;
+
+    auto subscribed = subscriptions_.find(pid);
+    return subscribed != subscriptions_.end() ? subscribed->second : none;
+}
+
+void GroupTable::set_sequence(uint32_t group, uint16_t pid, uint64_t sequence) {
+    auto entry = groups_.find(group);
+    if (entry == groups_.end()) return;
+
+    entry->second.sequences[pid] = sequence;
+}
+
+uint64_t GroupTable::sequence(uint32_t group, uint16_t pid) const {
+    auto entry = groups_.find(group);
+    if (entry == groups_.end()) return 0;
+
+    auto sequence = entry->second.sequences.find(pid);
+    return sequence != entry->second.sequences.end() ? sequence->second : 0;
+}
@@ -0,0 +1,111 @@
+// File: include/async_logger.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "spsc_queue.hpp"
+
+// Represents when lines written by an `AsyncLogger` are forced to disk
+enum class LogSync {
+    // Never; the operating system writes them back whenever it likes
+    NONE,
+
+    // After every write
+    EVERY_WRITE,
+
+    // At most once every `LoggerOptions::sync_interval`
+    PERIODIC
+};
+
+// Represents the settings of an `AsyncLogger`
+struct LoggerOptions {
+    // The number of lines that may wait to be written before `log` has to wait for room
+    size_t queue_capacity = 8192;
+
+    // The most bytes of lines that are gathered into one write
+    size_t batch_bytes = 64 * 1024;
+
+    // How long a line may wait for later lines to be written along with it
+    std::chrono::milliseconds flush_interval = std::chrono::milliseconds(0);
+
+    // When written lines are forced to disk
+    LogSync sync = LogSync::NONE;
+
+    // How often written lines are forced to disk when `sync` is `PERIODIC`
+    std::chrono::milliseconds sync_interval = std::chrono::milliseconds(1000);
+
+    // True if every line is also printed to standard output
+    bool echo = true;
+};
+
+// Appends lines to a log file from a background thread, so that the thread producing them never
+// waits on the filesystem
+//
+// Lines are handed over through a lock-free single-producer single-consumer queue. The background
+// thread keeps the file open and writes every line that has queued up since its last write with a
+// single call (group commit), so the busier the producer is, the larger and fewer the writes get.
+//
+// Note: `log` must only ever be called from one thread at a time
+class AsyncLogger {
+  public:
+    // Opens `path` for appending and starts the background thread described by `options`
+    AsyncLogger(std::string path, LoggerOptions options = LoggerOptions());
+
+    // Makes this logger non-copyable and non-copy-assignable
+    AsyncLogger(AsyncLogger &other) = delete;
+    AsyncLogger &operator=(AsyncLogger &other) = delete;
+
+    // Writes every line that is still queued, forces it to disk unless `sync` is `NONE`, and
+    // closes the file
+    ~AsyncLogger();
+
+    // Queues `line` to be appended to the log, waiting only if the queue is full
+    void log(std::string line);
+
+  private:
+    // The loop run by the background thread
+    void run_();
+
+    // Writes `pending` to the log (and standard output), then empties it
+    void write_(std::string &pending);
+
+    // Forces everything written so far to disk
+    void sync_();
+
+    // The settings of this logger
+    LoggerOptions options_;
+
+    // The file descriptor of the log file
+    int file_desc_;
+
+    // The lines waiting to be written
+    SpscQueue<std::string> queue_;
+
+    // When everything written so far was last forced to disk
+    std::chrono::steady_clock::time_point last_sync_;
+
+    // True if lines have been written since they were last forced to disk
+    bool unsynced_;
+
+    // True when the background thread should write what is left and stop
+    std::atomic<bool> stopping_;
+
+    // True while the background thread is waiting for lines
+    std::atomic<bool> sleeping_;
+
+    // Used to put the background thread to sleep while the queue is empty
+    std::mutex idle_lock_;
+
+    // Signalled when a line is queued while the background thread sleeps, or when stopping
+    std::condition_variable idle_cv_;
+
+    // The background thread
+    std::thread worker_;
+};
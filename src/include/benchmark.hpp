@@ -0,0 +1,209 @@
+// File: include/benchmark.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_reader.hpp"
+#include "multicast_message.hpp"
+#include "inet/event_loop.hpp"
+#include "inet/internet_socket.hpp"
+
+// Represents the settings of a `Benchmark`
+struct BenchmarkOptions {
+    // The port the coordinator under test listens on; participants listen on the ports after it
+    uint16_t coordinator_port = 9000;
+
+    // The number of synthetic participants
+    size_t participants = 8;
+
+    // The number of multicast messages sent per second
+    size_t msends_per_second = 1000;
+
+    // The size of the body of every multicast message, in bytes
+    size_t message_size = 64;
+
+    // How long messages are sent for, in seconds
+    size_t duration_seconds = 10;
+
+    // How often a random participant disconnects (and later reconnects), per second
+    double disconnects_per_second = 0;
+
+    // The number of shards the coordinator runs
+    size_t coordinator_shards = 1;
+
+    // The smallest multicast message body that is compressed, or 0 to send every body as is
+    size_t compression_threshold = 0;
+
+    // The path of the coordinator executable to start
+    std::string coordinator_path = "bin/mycoordinator";
+};
+
+// Measures the coordinator end to end by starting a local coordinator and driving it with
+// synthetic participants over loopback
+//
+// One thread sends multicast messages at a fixed rate over a single connection, one thread makes
+// random participants disconnect and reconnect, and one thread receives the messages delivered to
+// every participant through an `EventLoop`. Each message body starts with its sequence number and
+// the time it was sent, so the receiving thread can measure fan-out latency and replay speed.
+class Benchmark {
+  public:
+    // Constructs a benchmark described by `options`
+    explicit Benchmark(BenchmarkOptions options);
+
+    // Makes this benchmark non-copyable and non-copy-assignable
+    Benchmark(Benchmark &other) = delete;
+    Benchmark &operator=(Benchmark &other) = delete;
+
+    // Stops the coordinator if it is still running
+    ~Benchmark();
+
+    // Starts the coordinator, registers every participant, applies the load and prints a report
+    //
+    // Returns false if the coordinator could not be started
+    bool run();
+
+  private:
+    // Represents a synthetic participant
+    struct Member {
+        // The ID of this participant
+        uint16_t pid;
+
+        // The port this participant receives multicast messages on
+        uint16_t port;
+
+        // The socket this participant receives connections from the coordinator on
+        InternetSocket listener;
+
+        // True while this participant is connected to the multicast group
+        bool connected = false;
+
+        // The first and last sequence numbers that this participant missed while it was
+        // disconnected, which it receives before anything else once it reconnects
+        std::atomic<uint64_t> missed_from = 0, missed_through = 0;
+
+        // When this participant asked to reconnect, in nanoseconds
+        std::atomic<int64_t> reconnected_at = 0;
+    };
+
+    // Represents a connection from the coordinator to a participant
+    struct Delivery {
+        // The index of the participant receiving on this connection
+        size_t member;
+
+        // The connection
+        InternetSocket socket;
+
+        // Receives the frames sent by the coordinator
+        FrameReader reader;
+
+        // The last sequence number that is replayed on this connection, or 0 if nothing is
+        uint64_t replay_through = 0;
+
+        // The number of messages and bytes that have been replayed on this connection so far
+        size_t replayed_messages = 0, replayed_bytes = 0;
+    };
+
+    // Represents one replay of missed messages that completed
+    struct Replay {
+        // The number of messages replayed
+        size_t messages;
+
+        // The number of bytes replayed
+        size_t bytes;
+
+        // How long the replay took from the reconnect request, in seconds
+        double seconds;
+    };
+
+    // Starts the coordinator as a child process and waits until it accepts connections
+    bool start_coordinator_();
+
+    // Stops the coordinator child process
+    void stop_coordinator_();
+
+    // Sends a request of `type` with body `body` for participant `pid` on a fresh connection and
+    // returns true if the coordinator acknowledged it
+    bool request_(MulticastMessageType type, uint16_t pid, std::string body);
+
+    // Sends multicast messages at the configured rate until the duration is over
+    void send_load_();
+
+    // Receives the acknowledgements of the multicast messages sent on `socket`
+    void drain_acks_(InternetSocket &socket);
+
+    // Disconnects and reconnects random participants until the load stops, then reconnects
+    // every participant that is still disconnected
+    void churn_();
+
+    // Receives every delivery to every participant until the benchmark stops
+    void receive_();
+
+    // Receives everything that is available on `delivery`, returning false once it has closed
+    bool read_delivery_(Delivery &delivery);
+
+    // Records the arrival of a multicast message whose (decompressed) body is the `size` bytes of
+    // `body` and whose frame took up `frame_size` bytes on `delivery`
+    void record_message_(Delivery &delivery, const char *body, size_t size, size_t frame_size);
+
+    // Prints the measurements of a run that sent messages for `seconds`
+    void report_(double seconds);
+
+    // Returns the current time of the steady clock, in nanoseconds
+    static int64_t now_();
+
+    // The settings of this benchmark
+    BenchmarkOptions options_;
+
+    // The process ID of the coordinator, or -1 if it is not running
+    pid_t coordinator_process_;
+
+    // The path of the configuration file written for the coordinator
+    std::string coordinator_config_;
+
+    // Every synthetic participant
+    std::vector<std::unique_ptr<Member>> members_;
+
+    // Waits on the listeners and deliveries of every participant
+    EventLoop event_loop_;
+
+    // Every open connection from the coordinator (receiving thread only)
+    // Key: event loop token
+    // Val: connection
+    std::unordered_map<uint64_t, std::unique_ptr<Delivery>> deliveries_;
+
+    // The token of the next connection from the coordinator (receiving thread only)
+    uint64_t next_delivery_token_;
+
+    // The fan-out latency of every live message delivered, in nanoseconds (receiving thread only)
+    std::vector<int64_t> latencies_;
+
+    // Every replay that completed (receiving thread only)
+    std::vector<Replay> replays_;
+
+    // The sequence number of the last multicast message sent
+    std::atomic<uint64_t> last_sent_;
+
+    // The number of multicast messages that the coordinator acknowledged
+    std::atomic<uint64_t> acknowledged_;
+
+    // The number of disconnects made by `churn_`
+    std::atomic<size_t> disconnects_;
+
+    // When the last message was delivered, in nanoseconds
+    std::atomic<int64_t> last_delivery_;
+
+    // True while messages are being sent
+    std::atomic<bool> sending_;
+
+    // True while deliveries are being received
+    std::atomic<bool> receiving_;
+};
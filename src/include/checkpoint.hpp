@@ -0,0 +1,171 @@
+// File: include/checkpoint.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "membership_table.hpp"
+
+// Represents everything a checkpoint holds about one participant's subscription to a named group
+struct CheckpointSubscription {
+    // The id and name of the group
+    uint32_t group = 0;
+    std::string name;
+
+    // The sequence number of the last message of the group delivered to the participant before it
+    // stopped receiving them (DISCONNECTED or spilling only)
+    uint64_t sequence = 0;
+
+    // True if the group's message log has a cursor for the participant, in which case the offset
+    // that the cursor starts at and when the participant's window closes
+    bool has_cursor = false;
+    uint64_t cursor_from = 0;
+    time_t cursor_expires_at = 0;
+};
+
+// Represents everything a checkpoint holds about one registered participant
+struct CheckpointEntry {
+    // Where the participant stands with the group
+    MemberState state = MemberState::UNREGISTERED;
+
+    // The IP address and port that the participant listens at
+    std::string ip;
+    uint16_t port = 0;
+
+    // When the participant disconnected, and the sequence number of the last message it was
+    // delivered before then (DISCONNECTED only)
+    time_t disconnect_time = 0;
+    uint64_t sequence = 0;
+
+    // True if the message log has a cursor for the participant, in which case the offset that the
+    // cursor starts at and when the participant's window closes
+    bool has_cursor = false;
+    uint64_t cursor_from = 0;
+    time_t cursor_expires_at = 0;
+
+    // The sequence number of the first message stored instead of delivered, for a connected
+    // participant whose messages are being spilled, or 0
+    uint64_t spilled_from = 0;
+
+    // Every named group that the participant subscribes to
+    std::vector<CheckpointSubscription> subscriptions;
+};
+
+// Keeps the membership and message log cursors of one coordinator shard in a memory-mapped file, so
+// that a coordinator that restarts carries on where the last one stopped
+//
+// The file starts with a header that holds the sequence number of the last multicast message the
+// shard delivered, which is updated in place for every message, followed by a snapshot of every
+// registered participant and named group and then a delta record for each change since. Each named
+// group has a record of its own that ends with the sequence number of its last message, which is
+// likewise updated in place and left out of the record's checksum. Recording a change copies
+// one record into the mapping, which the kernel writes back on its own, so it takes no system call
+// and survives the coordinator being killed right after. Once the deltas fill the file, a fresh
+// snapshot is written to a temporary file that is renamed over it, which also happens every time a
+// checkpoint is opened.
+//
+// Each record is the size of its payload and a checksum of its type and payload (each a uint32),
+// followed by its type and payload, all in the byte order of the machine that wrote it. Loading
+// stops at the first record that fails its checksum, which is one that was only partly written.
+//
+// Note: A checkpoint must only be changed from one thread at a time
+class Checkpoint {
+  public:
+    // Opens the checkpoint at `path`, loading what it holds if it was written by a coordinator with
+    // `shard_count` shards, and starts it over with a snapshot of that
+    Checkpoint(std::string path, size_t shard_count);
+
+    // Makes this checkpoint non-copyable and non-copy-assignable
+    Checkpoint(Checkpoint &other) = delete;
+    Checkpoint &operator=(Checkpoint &other) = delete;
+
+    // Unmaps the file
+    ~Checkpoint();
+
+    // Returns every registered participant held by the checkpoint
+    // Key: pid
+    // Val: what is known about the participant
+    const std::map<uint16_t, CheckpointEntry> &entries() const;
+
+    // Returns the sequence number of the last multicast message the shard delivered
+    uint64_t last_sequence() const;
+
+    // Returns the sequence number of the last message of every named group the shard delivered
+    // Key: group id
+    // Val: sequence number
+    const std::unordered_map<uint32_t, uint64_t> &group_sequences() const;
+
+    // Records that participant `pid` now stands as `entry` describes, where an UNREGISTERED entry
+    // means that it deregistered
+    void put(uint16_t pid, const CheckpointEntry &entry);
+
+    // Records that the shard delivered multicast message number `sequence`
+    void set_last_sequence(uint64_t sequence);
+
+    // Records that the shard delivered message number `sequence` of the named group `group`
+    void set_group_sequence(uint32_t group, uint64_t sequence);
+
+  private:
+    // The kinds of records in the file
+    enum class RecordType : uint8_t {
+        // Everything known about one participant, which replaces what was known before
+        ENTRY = 1,
+
+        // A participant that deregistered
+        REMOVED,
+
+        // The sequence number of the last message of a named group, which is updated in place
+        GROUP_SEQUENCE
+    };
+
+    // Loads every record from the file at `path_` if it holds a valid checkpoint
+    void load_();
+
+    // Applies the record of `type` with `payload`, returning false if it is malformed
+    bool apply_(RecordType type, const char *payload, size_t size);
+
+    // Appends `record` to the mapping, or writes a fresh snapshot if the mapping has no room left
+    // for it
+    //
+    // Returns false if a snapshot was written instead
+    bool append_(const std::string &record);
+
+    // Replaces the file with a snapshot of every entry and maps it
+    void snapshot_();
+
+    // The path of the checkpoint file
+    std::string path_;
+
+    // The number of shards of the coordinator writing the checkpoint
+    size_t shard_count_;
+
+    // What is known about every registered participant
+    // Key: pid
+    // Val: entry
+    std::map<uint16_t, CheckpointEntry> entries_;
+
+    // The sequence number of the last multicast message the shard delivered
+    uint64_t last_sequence_;
+
+    // The sequence number of the last message of every named group the shard delivered
+    // Key: group id
+    // Val: sequence number
+    std::unordered_map<uint32_t, uint64_t> group_sequences_;
+
+    // Where the sequence number of every named group is in the mapping
+    // Key: group id
+    // Val: offset
+    std::unordered_map<uint32_t, size_t> group_slots_;
+
+    // The mapping of the file, its size and how much of it holds records
+    char *mapping_;
+    size_t capacity_;
+    size_t used_;
+};
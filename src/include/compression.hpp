@@ -0,0 +1,28 @@
+// File: include/compression.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// The most bytes that a payload may decompress to when no limit is given
+static const size_t DEFAULT_MAX_DECOMPRESSED_SIZE = 64 * 1024 * 1024;
+
+// Compresses the `size` bytes of `data` with a small LZ77 codec, returning the uncompressed size
+// (as a little-endian uint32) followed by the compressed block
+//
+// The block uses the LZ4 block format: a series of sequences, each of which is a run of literal
+// bytes followed by a copy of earlier output, found through a hash table of the last position each
+// 4-byte string was seen at. It trades ratio for speed, which suits text that is compressed once by
+// the producer and decompressed once by every recipient.
+//
+// Note: Incompressible data grows by a few bytes, so callers should keep whichever is smaller
+std::string compress_payload(const char *data, size_t size);
+
+// Decompresses the `size` bytes of `data`, a payload returned by `compress_payload`, into `result`
+//
+// Returns false, leaving `result` unspecified, if the payload is malformed or would decompress to
+// more than `max_size` bytes
+bool decompress_payload(const char *data, size_t size, std::string &result,
+                        size_t max_size = DEFAULT_MAX_DECOMPRESSED_SIZE);
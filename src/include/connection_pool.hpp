@@ -0,0 +1,95 @@
+// File: include/connection_pool.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "inet/buffer.hpp"
+#include "inet/internet_socket.hpp"
+
+// Represents how sending to a participant went
+enum class SendResult {
+    // Everything was sent
+    SENT,
+
+    // The participant has no pooled connection or could not be reached
+    FAILED,
+
+    // The participant stopped reading for longer than the send timeout, so its connection was
+    // closed partway through
+    TIMED_OUT
+};
+
+// Keeps one long-lived outbound connection to each connected participant, so that multicast
+// messages can be delivered without a connection handshake (and address lookup) per message
+//
+// A send waits at most the send timeout for a participant to make room. A participant that stops
+// reading for longer has its connection closed, since it has already been sent part of a frame,
+// and is only dialed again by the next send after that.
+//
+// Note: Calls for different participants may be made from different threads at the same time, but
+//       calls for the same participant must not overlap
+class ConnectionPool {
+  public:
+    // Constructs a pool whose sends wait at most `send_timeout` for a participant to make room, or
+    // forever if it is 0
+    explicit ConnectionPool(std::chrono::milliseconds send_timeout = std::chrono::milliseconds(0));
+
+    // Resolves the address of participant `pid` listening at `ip`:`port` and opens a connection to
+    // it, replacing any connection that was previously pooled for that participant
+    //
+    // Note: If the participant cannot be reached yet, the connection is dialed on the next `send`
+    void open(uint16_t pid, std::string ip, uint16_t port);
+
+    // Sends all of `data` to participant `pid` over its pooled connection, redialing the
+    // participant once if the pooled connection has broken
+    SendResult send(uint16_t pid, const Buffer &data);
+
+    // Sends every buffer in `data`, in order, to participant `pid` over its pooled connection as
+    // if they were one contiguous buffer, redialing the participant once if the pooled connection
+    // has broken
+    SendResult sendv(uint16_t pid, const std::vector<Buffer> &data);
+
+    // Closes the pooled connection of participant `pid`, if it has one
+    void close(uint16_t pid);
+
+  private:
+    struct PooledConnection {
+        // The resolved address that the participant is listening on
+        InternetAddress address;
+
+        // The connection to the participant
+        InternetSocket socket;
+
+        // True if `socket` is believed to be connected to the participant
+        bool connected = false;
+    };
+
+    // Replaces the socket of `connection` with a freshly dialed one, returning true if the
+    // participant could be reached
+    bool redial_(PooledConnection &connection);
+
+    // Calls `send_on` with the socket of the pooled connection of participant `pid`, redialing the
+    // participant and calling it again once if the pooled connection has broken
+    template <typename SendOn>
+    SendResult send_(uint16_t pid, SendOn send_on);
+
+    // Returns the pooled connection of participant `pid`, or nullptr if it has none
+    PooledConnection *find_(uint16_t pid);
+
+    // How long a send waits for a participant to make room, or 0 to wait forever
+    std::chrono::milliseconds send_timeout_;
+
+    // Guards the structure of `connections_` (but not the connections themselves)
+    std::mutex connections_lock_;
+
+    // Every pooled connection
+    // Key: pid
+    // Val: connection to that participant
+    std::unordered_map<uint16_t, PooledConnection> connections_;
+};
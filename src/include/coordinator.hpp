@@ -7,19 +7,39 @@
 #include <iostream>
 #include <thread>
 #include <set>
+#include <map>
 #include <unordered_map>
 #include <vector>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <memory>
 #include <queue>
+#include <deque>
 
+#include "checkpoint.hpp"
+#include "delivery_pool.hpp"
+#include "frame_reader.hpp"
+#include "group_table.hpp"
+#include "membership_table.hpp"
+#include "message_log.hpp"
+#include "metrics.hpp"
 #include "multicast_message.hpp"
+#include "spsc_queue.hpp"
+#include "inet/event_loop.hpp"
 #include "inet/internet_socket.hpp"
 
 class Coordinator {
     public:
-        // Constructs a coordinator that waits for incoming messages on `localport` and
-        // has a persistence time threshold of `persistence_time`
-        Coordinator(uint16_t localport, int persistence_time);
+        // Constructs a coordinator that waits for incoming messages on `localport`, has a
+        // persistence time threshold of `persistence_time`, delivers multicast messages as
+        // described by `delivery_options`, serves participants from `shard_count` shards (from 1
+        // to `MAX_SHARD_COUNT`) and has
+        // participants compress msend bodies of at least `compression_threshold` bytes (or none
+        // if it is 0) and accepts frames of up to `max_frame_size` bytes, which larger msends are
+        // split to fit. Its metrics are written to `stats_path` once every `stats_interval`, unless
+        // `stats_path` is empty
+        Coordinator(uint16_t localport, int persistence_time, DeliveryOptions delivery_options = DeliveryOptions(), size_t shard_count = 1, size_t compression_threshold = 0, size_t max_frame_size = DEFAULT_MAX_FRAME_SIZE, std::string stats_path = "", std::chrono::seconds stats_interval = DEFAULT_STATS_INTERVAL);
 
         // Begins listening for connections
         void start();
@@ -27,20 +47,270 @@ class Coordinator {
         // Ends multicast coordinator session
         void stop();
 
+        // The most shards a coordinator may run, each of which takes a core of its own
+        static const size_t MAX_SHARD_COUNT = 64;
+
     private:
-        void handleIncomingMessages();
+        // The number of bytes received at a time from a participant connection, which is kept small
+        // since most requests are
+        static const size_t SESSION_READ_SIZE = 4 * 1024;
+
+        // The state of a participant connection that is being served by the event loop
+        struct Session {
+            // Constructs the session of a freshly accepted connection that accepts frames of up to
+            // `max_frame_size` bytes
+            Session(InternetSocket &&accepted, size_t max_frame_size) :
+                socket(std::move(accepted)), reader(SESSION_READ_SIZE, max_frame_size) {}
+
+            // The connection to the participant
+            InternetSocket socket;
+
+            // The IP address of the participant
+            std::string part_ip;
+
+            // Receives the requests sent by the participant
+            FrameReader reader;
+
+            // Responses that could not be written to the participant without blocking yet
+            std::string outbound;
+        };
+
+        // A message passed from one shard to another
+        struct ShardMessage {
+            enum class Kind {
+                // A request for the receiving shard to handle, which is acknowledged once it has been
+                // handled unless it came from a session that was acknowledged already
+                REQUEST,
+
+                // The acknowledgement of a forwarded request, to be sent on the session it arrived on
+                ACKNOWLEDGE,
+
+                // A multicast message to be delivered to the participants the receiving shard owns
+                MULTICAST
+            };
+
+            // The kind of message
+            Kind kind = Kind::REQUEST;
+
+            // REQUEST: The header and body of the request
+            // ACKNOWLEDGE: The header of the request that was handled
+            MulticastMessageHeader header = {};
+            std::string body;
+
+            // REQUEST: The IP address of the participant that sent the request
+            std::string part_ip;
+
+            // REQUEST and ACKNOWLEDGE: The token of the session on the forwarding shard that the
+            // request arrived on, or `NO_SESSION` if it needs no acknowledgement
+            uint64_t session = 0;
+
+            // MULTICAST: The serialized message, when it arrived at the coordinator, the named group
+            // it is addressed to (or 0 if it is addressed to everyone) and its number in that group's
+            // order
+            Buffer frame = Buffer(nullptr, 0);
+            time_t arrival_time = 0;
+            uint32_t group = 0;
+            uint64_t sequence = 0;
+        };
+
+        // Everything owned by one thread of the coordinator: a listener on the coordinator port, the
+        // connections that the kernel hands to that listener, and the participants whose pids leave
+        // the shard's index as their remainder when divided by the number of shards
+        //
+        // The first shard is also the sequencer, which numbers every multicast message before handing
+        // it to the other shards, so every shard delivers and logs them in the same order
+        struct Shard {
+            // Constructs shard `index` of `shard_count`, storing missed messages in `log_directory`
+            Shard(size_t index, size_t shard_count, std::string log_directory, DeliveryOptions delivery_options);
+
+            // The position of this shard among all shards
+            size_t index;
+
+            // The directory that this shard's message logs are stored in
+            std::string log_directory;
+
+            // The listener on the coordinator port that accepts this shard's connections
+            InternetSocket socket;
+
+            // The thread that runs this shard
+            std::thread thread;
+
+            // Waits on the listener, every connection of this shard and messages from other shards
+            EventLoop event_loop;
+
+            // Every participant connection that is currently open on this shard
+            // Key: event loop token
+            // Val: session state
+            std::unordered_map<uint64_t, std::unique_ptr<Session>> sessions;
+
+            // The event loop token that will be given to the next accepted connection
+            uint64_t next_session_token = 1;
+
+            // Every participant this shard owns, whether connected or not, and where its missed
+            // messages begin
+            MembershipTable members;
+
+            // Delivers multicast messages to the connected participants this shard owns
+            DeliveryPool delivery_pool;
+
+            // Stores every multicast message once for the disconnected participants this shard owns
+            MessageLog message_log;
+
+            // Keeps where every participant this shard owns stands, so a restarted coordinator can
+            // carry on without the participants having to do anything
+            Checkpoint checkpoint;
+
+            // The sequence number of the last multicast message this shard delivered
+            uint64_t last_sequence = 0;
+
+            // Every named group that the participants this shard owns subscribe to, and what each of
+            // them missed of it
+            GroupTable groups;
+
+            // Stores every message of a named group once for the subscribers this shard owns that
+            // are not receiving them, each group in a directory of its own. A group's log is opened
+            // when it is first subscribed to and kept until the coordinator stops
+            // Key: group id
+            // Val: message log
+            std::map<uint32_t, std::unique_ptr<MessageLog>> group_logs;
+
+            // Guards `group_logs` against the shard adding to it while other threads walk it, which
+            // the shard itself does not need to take to read it
+            std::mutex group_logs_lock;
+
+            // The sequence number of the last message of each named group this shard delivered
+            // Key: group id
+            // Val: sequence number
+            std::unordered_map<uint32_t, uint64_t> group_sequences;
+
+            // Every connected participant whose mailbox filled up, whose messages are stored in the
+            // message logs until it catches up
+            // Key: pid
+            // Val: sequence number of the first message stored instead of delivered
+            std::unordered_map<uint16_t, uint64_t> spilling;
 
-        void handleRequest(MulticastMessage part_req, std::string part_ip);
+            // The messages sent to this shard, one lock-free queue per sending shard
+            std::vector<std::unique_ptr<SpscQueue<ShardMessage>>> inbound;
 
-        void handleRegister(MulticastMessage part_req, std::string part_ip);
+            // Messages for each shard that did not fit in its inbound queue yet
+            std::vector<std::deque<ShardMessage>> overflow;
 
-        void handleDeregister(MulticastMessage part_req);
+            // True for each shard that has been sent messages since it was last woken up
+            std::vector<bool> pending_wakes;
+        };
 
-        void handleReconnect(MulticastMessage part_req);
+        // Runs the event loop that serves every connection of `shard` until the coordinator stops
+        void handleIncomingMessages(Shard &shard);
 
-        void handleDisconnect(MulticastMessage part_req);
+        // Accepts every connection that is waiting on the listener of `shard`
+        //
+        // Returns false if some were left waiting because the process ran out of file descriptors
+        // or memory
+        bool acceptSessions(Shard &shard);
 
-        void handleMSend(MulticastMessage part_req);
+        // Receives everything that is available on the session `token` of `shard`, handling each
+        // request that completes
+        //
+        // Returns false if the session has been closed and should be dropped
+        bool readSession(Shard &shard, uint64_t token, Session &session);
+
+        // Acknowledges and handles the request with `header` and body `data` that was received on
+        // the session `token` of `shard`, or forwards it to the shard that owns its participant
+        //
+        // Returns false if the session should be dropped
+        bool dispatchRequest(Shard &shard, uint64_t token, Session &session, MulticastMessageHeader header, std::string data);
+
+        // Returns the acknowledgement of the request with `header`
+        MulticastMessage acknowledge(MulticastMessageHeader header);
+
+        // Writes as much of the outbound responses of `session` as can be written without blocking
+        //
+        // Returns false if the session has broken and should be dropped
+        bool flushSession(Session &session);
+
+        // Handles every message that other shards have sent to `shard`
+        void receiveShardMessages(Shard &shard);
+
+        // Queues `message` to be sent from `shard` to the shard at `target`
+        void sendShardMessage(Shard &shard, size_t target, ShardMessage message);
+
+        // Moves the messages that `shard` could not queue yet into their inbound queues and wakes
+        // up every shard it queued messages for
+        //
+        // Returns true if some messages still could not be queued
+        bool flushShardMessages(Shard &shard);
+
+        // Returns the shard that owns participant `pid`
+        Shard &owner(uint16_t pid);
+
+        void handleRequest(Shard &shard, MulticastMessage &part_req, std::string part_ip);
+
+        void handleRegister(Shard &shard, MulticastMessage &part_req, std::string part_ip);
+
+        void handleDeregister(Shard &shard, MulticastMessage &part_req);
+
+        void handleReconnect(Shard &shard, MulticastMessage &part_req);
+
+        void handleDisconnect(Shard &shard, MulticastMessage &part_req);
+
+        void handleMSend(Shard &shard, MulticastMessage &part_req);
+
+        void handleSubscribe(Shard &shard, MulticastMessage &part_req);
+
+        void handleUnsubscribe(Shard &shard, MulticastMessage &part_req);
+
+        // Delivers the serialized multicast message `frame`, which arrived at `arrival_time` and is
+        // number `sequence` in the order of `group` (or of every message addressed to everyone, if
+        // `group` is 0), to every participant that `shard` owns and that is part of the group
+        void deliverMulticast(Shard &shard, Buffer frame, time_t arrival_time, uint32_t group, uint64_t sequence);
+
+        // Applies the overflow policy to participant `pid`, whose mailbox was too full to take
+        // message number `sequence` of `group`
+        void handleOverflow(Shard &shard, uint16_t pid, uint32_t group, uint64_t sequence);
+
+        // Returns the message log of the named group `group` on `shard`, opening it if the shard has
+        // none yet
+        MessageLog &groupLog(Shard &shard, uint32_t group);
+
+        // Replays the records of `log` from `from` up to where the cursor of participant `pid` ends,
+        // and closes the cursor
+        void replayCursor(Shard &shard, uint16_t pid, MessageLog &log, uint64_t from);
+
+        // Unsubscribes participant `pid` from every named group, dropping whatever was stored for it
+        void dropSubscriptions(Shard &shard, uint16_t pid);
+
+        // Records that `id` is the id of the group called `name`
+        //
+        // Returns false if `id` already belongs to a group with a different name
+        //
+        // Note: May be called from any thread
+        bool claimGroupName(uint32_t id, const std::string &name);
+
+        // Returns the name of the group whose id is `id`, or an empty string if it was never claimed
+        //
+        // Note: May be called from any thread
+        std::string groupName(uint32_t id);
+
+        // Replays what was stored for every spilling participant of `shard` that has caught up, and
+        // goes back to delivering it messages directly
+        void resumeSpilled(Shard &shard);
+
+        // Records where participant `pid` stands in the checkpoint of `shard`, which owns it
+        void checkpointMember(Shard &shard, uint16_t pid);
+
+        // Restores the participants, message log cursors and sequence numbers held by the checkpoint
+        // of every shard, so that delivery and replay carry on where the last coordinator stopped
+        void restoreCheckpoints();
+
+        // Removes messages that fell out of every persistence window from the message logs, once
+        // every `COMPACTION_INTERVAL`, until the coordinator stops
+        void compactMessageLog();
+
+        // Returns one line for every participant whose messages are waiting to be delivered, were
+        // dropped or are stored in the message log, saying how many
+        //
+        // Note: May be called from any thread
+        std::string backlogReport();
         
         // The port that this coordinator is listening on
         uint16_t localport_;
@@ -48,30 +318,36 @@ class Coordinator {
         // Time (in seconds) that messages will persist for disconnected participants
         int persistence_time_;
 
-        // port that will accept connections from participants
-        InternetSocket coordinator_socket_;
+        // The smallest msend body that participants compress, or 0 if compression is disabled
+        size_t compression_threshold_;
+
+        // The largest frame, header included, that a participant may send
+        size_t max_frame_size_;
 
-        // Threads that is actively listening for messages
-        std::thread incoming_messages_thread_;
+        // The file that metrics are written to, or empty if they are not
+        std::string stats_path_;
+
+        // How often metrics are written to `stats_path_`
+        std::chrono::seconds stats_interval_;
+
+        // Thread that compacts the message log in the background
+        std::thread compaction_thread_;
+
+        // Used to wake up the compaction thread when the coordinator stops
+        std::mutex compaction_lock_;
+        std::condition_variable compaction_cv_;
         
         // True when the Coordinator is not attempting to stop its operation
         std::atomic<bool> is_running_;
 
-        // Set of every participant id that is connected
-        // Key: pid
-        // Val: port
-        std::unordered_map<uint16_t, int> pids_connected_;
-
-        // Set of every participant id that is registered
-        // Key: pid
-        // Val: ip addr
-        std::unordered_map<int, std::string> pids_registered_;
+        // Every shard of the coordinator, each of which runs on its own thread
+        std::vector<std::unique_ptr<Shard>> shards_;
 
-        // Map of every registered but disconnected pid, with a set of messages they miss 
-        // Key: pid
-        // Val: filename
-        std::unordered_map<int, std::string> pids_disconnected_;
+        // The name of every named group that has been subscribed to, shared by every shard
+        // Key: group id
+        // Val: group name
+        std::unordered_map<uint32_t, std::string> group_names_;
 
-        // Map of times that participants disconnected
-        std::unordered_map<int, time_t> disconnect_times;
+        // Guards `group_names_`
+        std::mutex group_names_lock_;
 };
\ No newline at end of file
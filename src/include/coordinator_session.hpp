@@ -0,0 +1,129 @@
+// File: include/coordinator_session.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "multicast_message.hpp"
+#include "inet/internet_socket.hpp"
+
+// Represents the coordinator's answer to a request
+struct Reply {
+    // The header of the answer, whose type is INVALID if the connection closed before it arrived
+    MulticastMessageHeader header;
+
+    // The body of the answer
+    std::string body;
+};
+
+// Keeps one long-lived connection from a participant to the coordinator, over which requests are
+// pipelined rather than each paying for a connection handshake and a round trip
+//
+// Every request is tagged with a request id that the coordinator copies into its answer, so answers
+// are matched to their requests in whatever order they arrive. A request may either wait for its
+// answer (`request`), or be sent while up to `window` others are still unanswered and have its
+// answer handed to a callback on the thread that reads answers (`send`), so a producer is limited
+// by bandwidth instead of by latency.
+//
+// Requests that cannot carry a request id (REGISTER, whose version is not agreed on yet, and any
+// request of a version older than `REQUEST_ID_VERSION`) are only sent once nothing else is in
+// flight, and nothing else is sent until they are answered.
+//
+// Note: The connection is dialed on first use and redialed after it closes. Requests must only be
+//       sent from one thread at a time
+class CoordinatorSession {
+  public:
+    // Constructs a session with the coordinator at `address`:`port` that allows up to `window`
+    // requests to be in flight at once
+    CoordinatorSession(std::string address, uint16_t port, size_t window = DEFAULT_WINDOW);
+
+    // Waits for every request in flight to be answered and closes the connection
+    ~CoordinatorSession();
+
+    // Makes this session non-copyable and non-copy-assignable
+    CoordinatorSession(CoordinatorSession &other) = delete;
+    CoordinatorSession &operator=(CoordinatorSession &other) = delete;
+
+    // The number of requests that may be in flight when no window is given
+    static const size_t DEFAULT_WINDOW = 64;
+
+    // The largest answer, header included, that is accepted before the connection is dropped
+    static const size_t MAX_REPLY_SIZE = DEFAULT_MAX_FRAME_SIZE;
+
+    // Sends `request` and blocks until it is answered
+    Reply request(MulticastMessage request);
+
+    // Sends `request` without waiting for its answer, first waiting while the window is full, and
+    // calls `on_reply` with the answer on the thread that reads answers
+    //
+    // Note: `on_reply` must not call back into this session
+    void send(MulticastMessage request, std::function<void(const Reply &)> on_reply);
+
+    // Blocks until every request sent so far has been answered
+    void drain();
+
+    // Waits for every request in flight to be answered and closes the connection
+    void close();
+
+  private:
+    // Represents a request that has not been answered yet
+    struct Pending {
+        // What to call with its answer
+        std::function<void(const Reply &)> on_reply;
+
+        // When it was sent
+        std::chrono::steady_clock::time_point sent_at;
+    };
+
+    // Waits until `request` may be sent, registers `on_reply` as its answer handler and tags it
+    // with a request id if it can carry one, then sends it
+    void send_(MulticastMessage &request, std::function<void(const Reply &)> on_reply);
+
+    // Dials the coordinator and starts reading answers if the connection is not open
+    //
+    // Note: `lock_` must be held
+    void connect_();
+
+    // Reads answers and hands each one to the handler of its request until the connection closes
+    void read_replies_();
+
+    // The address of the coordinator
+    std::string address_;
+
+    // The port of the coordinator
+    uint16_t port_;
+
+    // The most requests that may be in flight at once
+    size_t window_;
+
+    // The connection to the coordinator
+    InternetSocket socket_;
+
+    // True while `socket_` is connected and answers are being read from it
+    bool connected_;
+
+    // Reads answers from `socket_`
+    std::thread reader_;
+
+    // Guards `connected_`, `pending_` and `next_request_id_`
+    std::mutex lock_;
+
+    // Notified whenever a request is answered or the connection closes
+    std::condition_variable answered_;
+
+    // Every request in flight
+    // Key: request id, or 0 for the one request in flight without a request id
+    // Val: what to call with its answer and when it was sent
+    std::unordered_map<uint32_t, Pending> pending_;
+
+    // The request id that the next tagged request is sent with
+    uint32_t next_request_id_;
+};
@@ -0,0 +1,294 @@
+// File: include/delivery_pool.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "connection_pool.hpp"
+#include "message_log.hpp"
+#include "multicast_message.hpp"
+#include "inet/buffer.hpp"
+
+// Represents what happens when the mailbox of a participant is full
+enum class OverflowPolicy {
+    // The oldest messages waiting for the participant are dropped to make room for new ones
+    DROP_OLDEST,
+
+    // The participant is disconnected, and receives what it missed from the message log once it
+    // reconnects
+    DISCONNECT,
+
+    // New messages for the participant are stored in the message log instead, and replayed to it
+    // once it has caught up
+    SPILL
+};
+
+// Represents the settings of a `DeliveryPool`
+struct DeliveryOptions {
+    // The number of worker threads
+    size_t workers = 4;
+
+    // The most bytes that messages waiting for the same participant are coalesced into, as one
+    // MULTI_MESSAGE_BATCH frame
+    size_t batch_max_bytes = 64 * 1024;
+
+    // How long a message may wait for more messages to be coalesced with it before it is sent
+    std::chrono::microseconds batch_linger = std::chrono::microseconds(0);
+
+    // The most messages that may wait for one participant before `overflow_policy` applies
+    size_t mailbox_max_messages = 16 * 1024;
+
+    // The most bytes of messages that may wait for one participant before `overflow_policy` applies
+    size_t mailbox_max_bytes = 16 * 1024 * 1024;
+
+    // What happens when the mailbox of a participant is full
+    OverflowPolicy overflow_policy = OverflowPolicy::SPILL;
+
+    // How long sending to a participant may wait for it to make room before it counts as having
+    // stopped reading, or 0 to wait forever
+    std::chrono::milliseconds send_timeout = std::chrono::milliseconds(5000);
+};
+
+// Represents how far the deliveries to one participant have fallen behind
+struct MailboxDepth {
+    // The number of messages waiting for the participant or being sent to it
+    size_t messages = 0;
+
+    // The number of bytes of those messages
+    size_t bytes = 0;
+
+    // The number of messages that were dropped because the participant's mailbox was full
+    uint64_t dropped = 0;
+};
+
+// Delivers multicast messages to participants from a pool of worker threads, so that the thread
+// accepting requests never waits on a participant
+//
+// Every participant has its own mailbox of delivery jobs. A mailbox is only ever run by one worker
+// at a time, which keeps the jobs for each participant in order, while the mailboxes of different
+// participants are run in parallel. Workers take ready mailboxes from their own queue and steal
+// them from the queues of other workers when their own queue is empty.
+//
+// Mailboxes are bounded, so a participant that reads slowly only ever holds up its own messages.
+// Once the messages waiting for a participant reach the limits in the options, the oldest are
+// dropped or `deliver` refuses new ones, depending on the overflow policy.
+//
+// A participant that stops reading altogether would keep a worker waiting inside a send, so a send
+// gives up after the send timeout. The frames still waiting for the participant in that run are
+// dropped, and unless the overflow policy is DROP_OLDEST its mailbox then counts as full until the
+// participant connects again or, after as long again, catches up.
+class DeliveryPool {
+  public:
+    // Starts the delivery workers described by `options`
+    explicit DeliveryPool(DeliveryOptions options);
+
+    // Makes this pool non-copyable and non-copy-assignable
+    DeliveryPool(DeliveryPool &other) = delete;
+    DeliveryPool &operator=(DeliveryPool &other) = delete;
+
+    // Stops and joins every delivery worker
+    ~DeliveryPool();
+
+    // Queues opening a long-lived connection to participant `pid` listening at `ip`:`port`
+    void open(uint16_t pid, std::string ip, uint16_t port);
+
+    // Queues sending `frame` to participant `pid`
+    //
+    // Returns false without queueing `frame` if the mailbox of `pid` is full and the overflow
+    // policy is not DROP_OLDEST, in which case the caller is left to apply the policy
+    bool deliver(uint16_t pid, Buffer frame);
+
+    // Queues sending `notice` to participant `pid` even if its mailbox is full, then closing the
+    // connection to it
+    void evict(uint16_t pid, Buffer notice);
+
+    // Returns how far the deliveries to participant `pid` have fallen behind
+    MailboxDepth depth(uint16_t pid);
+
+    // Returns how far the deliveries to every participant have fallen behind, leaving out those
+    // with nothing waiting that never had messages dropped
+    // Key: pid
+    // Val: how far its deliveries have fallen behind
+    std::map<uint16_t, MailboxDepth> depths();
+
+    // Returns true if the messages waiting for participant `pid` are down to half of the limits,
+    // so that it can be given new messages again after its mailbox was full. A participant that
+    // stopped reading is given another chance once the send timeout has passed again
+    bool caught_up(uint16_t pid);
+
+    // Queues closing the connection to participant `pid`
+    void close(uint16_t pid);
+
+    // Queues streaming every message in `log` from `from` up to `to` to participant `pid`, then
+    // releasing the hold `hold` on `log`
+    void replay(uint16_t pid, MessageLog &log, uint64_t from, uint64_t to, uint64_t hold);
+
+    // The number of bytes that missed messages are gathered into before being sent
+    static const size_t REPLAY_WRITE_SIZE = 256 * 1024;
+
+    // Returns the settings this pool was started with
+    const DeliveryOptions &options() const;
+
+    // Stops every delivery worker once the jobs that they are running finish
+    void stop();
+
+  private:
+    // Represents a unit of work to be done for one participant
+    struct DeliveryJob {
+        enum class Kind { OPEN, SEND, CLOSE, REPLAY };
+
+        // The kind of work to be done
+        Kind kind;
+
+        // The IP address the participant listens on (OPEN only)
+        std::string ip;
+
+        // The port the participant listens on (OPEN only)
+        uint16_t port = 0;
+
+        // The frame to be sent to the participant (SEND, and CLOSE when it says goodbye first)
+        Buffer frame = Buffer(nullptr, 0);
+
+        // The log to replay from (REPLAY only)
+        MessageLog *log = nullptr;
+
+        // The range of the log to replay and the hold that keeps it from being deleted (REPLAY only)
+        uint64_t from = 0, to = 0, hold = 0;
+
+        // When this job was queued
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    // Represents the queue of jobs waiting to be run for one participant
+    struct Mailbox {
+        // Constructs the empty mailbox of participant `pid`, whose frames are coalesced into batches
+        // of up to `batch_max_bytes`
+        Mailbox(uint16_t pid, size_t batch_max_bytes) : pid(pid), batch(batch_max_bytes) {}
+
+        // The participant this mailbox belongs to
+        uint16_t pid;
+
+        // Guards `jobs`, `scheduled`, the counts of frames and `stalled`
+        std::mutex lock;
+
+        // The jobs waiting to be run, in the order they were queued
+        std::deque<DeliveryJob> jobs;
+
+        // True while this mailbox is waiting in a worker queue or being run by a worker
+        bool scheduled = false;
+
+        // The number and bytes of the frames in `jobs`, which the limits apply to
+        size_t queued_messages = 0, queued_bytes = 0;
+
+        // The number and bytes of the frames that a worker took from `jobs` and is still sending
+        size_t sending_messages = 0, sending_bytes = 0;
+
+        // The number of frames dropped because this mailbox was full
+        uint64_t dropped = 0;
+
+        // True once sending to the participant timed out, in which case the mailbox counts as full
+        // until the participant connects again or catches up after `stalled_until`
+        bool stalled = false;
+        std::chrono::steady_clock::time_point stalled_until;
+
+        // The jobs that a worker took from `jobs` and is running, which are kept between runs along
+        // with `batch` so that their memory is reused rather than allocated for every run
+        std::deque<DeliveryJob> running;
+
+        // Coalesces the frames in `running` that are sent together
+        MulticastBatch batch;
+    };
+
+    // Represents the queue of mailboxes that are ready to be run by one worker
+    struct WorkerQueue {
+        // Guards `ready`
+        std::mutex lock;
+
+        // Mailboxes with jobs waiting to be run
+        std::deque<Mailbox *> ready;
+    };
+
+    // Adds `job` to the mailbox of participant `pid`, scheduling the mailbox if it is idle. A SEND
+    // job is held to the limits of the mailbox
+    //
+    // Returns false if the job was refused because the mailbox is full
+    bool submit_(uint16_t pid, DeliveryJob job);
+
+    // Returns true if a frame of `frame_size` bytes fits in `mailbox`, first dropping its oldest
+    // frames if the overflow policy is DROP_OLDEST
+    //
+    // Note: The lock of `mailbox` must be held
+    bool make_room_(Mailbox &mailbox, size_t frame_size);
+
+    // Returns the mailbox of participant `pid`, creating it if it does not exist yet
+    Mailbox *mailbox_(uint16_t pid);
+
+    // Makes `mailbox` available to the worker with index `worker`
+    void schedule_(Mailbox *mailbox, size_t worker);
+
+    // Returns the next ready mailbox for the worker with index `worker`, preferring its own queue
+    // over stealing, or nullptr once the pool is stopping
+    Mailbox *take_(size_t worker);
+
+    // Runs every job that is waiting in `mailbox`
+    void run_(Mailbox *mailbox, size_t worker);
+
+    // Runs the jobs that were taken into the `running` queue of `mailbox` in order, coalescing
+    // consecutive frames into batches
+    void run_jobs_(Mailbox &mailbox);
+
+    // Runs a single job for participant `pid`
+    SendResult run_job_(uint16_t pid, DeliveryJob &job);
+
+    // Sends the frames in `batch` to participant `pid`, or just `single` if it is the only one
+    SendResult send_batch_(uint16_t pid, MulticastBatch &batch, DeliveryJob *single);
+
+    // Streams the missed messages described by the REPLAY `job` to participant `pid`
+    SendResult replay_(uint16_t pid, DeliveryJob &job);
+
+    // The loop run by each delivery worker
+    void work_(size_t worker);
+
+    // The settings this pool was started with
+    DeliveryOptions options_;
+
+    // The long-lived connections that frames are sent over
+    ConnectionPool connection_pool_;
+
+    // Guards `mailboxes_`
+    std::mutex mailboxes_lock_;
+
+    // The mailbox of every participant that has ever had a job
+    // Key: pid
+    // Val: mailbox of that participant
+    std::unordered_map<uint16_t, std::unique_ptr<Mailbox>> mailboxes_;
+
+    // The ready queue of each worker
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+
+    // Guards `ready_count_` and is used to put idle workers to sleep
+    std::mutex idle_lock_;
+
+    // Signalled when a mailbox becomes ready or the pool is stopping
+    std::condition_variable idle_cv_;
+
+    // The number of mailboxes that are waiting in any worker queue
+    long ready_count_ = 0;
+
+    // True when the workers should stop
+    std::atomic<bool> stopping_;
+
+    // The delivery workers
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,75 @@
+// File: include/frame_reader.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "multicast_message.hpp"
+#include "inet/buffer.hpp"
+#include "inet/internet_socket.hpp"
+
+// Reads whole frames (a `MulticastMessageHeader` followed by its body) from a stream socket
+//
+// Bytes are received into a read buffer with as few calls to `recv` as possible, and every complete
+// frame in the buffer is handed out without any further system calls, so a burst of frames that
+// arrives together costs a single read. The buffer grows to fit frames larger than itself, up to
+// the largest frame the reader accepts, so a peer cannot make it allocate more than that.
+class FrameReader {
+  public:
+    // Constructs a reader that receives up to `read_size` bytes at a time and accepts frames of up
+    // to `max_frame_size` bytes
+    explicit FrameReader(size_t read_size = DEFAULT_READ_SIZE, size_t max_frame_size = SIZE_MAX);
+
+    // The number of bytes received at a time when no read size is given
+    static const size_t DEFAULT_READ_SIZE = 64 * 1024;
+
+    // Takes the next complete frame out of the read buffer, setting `header` to its header and
+    // `body` to a view of its body. Returns false if no complete frame has been received yet, or if
+    // the next frame is oversized
+    //
+    // Note: `body` points into the read buffer and is only valid until the next `fill`, `try_fill`
+    //       or `read`
+    bool next(MulticastMessageHeader &header, Buffer &body);
+
+    // Returns true if the header at the front of the read buffer describes a frame larger than this
+    // reader accepts, which is then never received or handed out
+    bool oversized() const;
+
+    // Receives whatever bytes one call to `recv` returns from `socket`, blocking until at least one
+    // byte arrives. Returns false once the connection has been closed
+    bool fill(InternetSocket &socket);
+
+    // Receives bytes from the non-blocking `socket` until it would block, the connection closes or
+    // the read buffer is full
+    TransferInfo try_fill(InternetSocket &socket);
+
+    // Takes the next frame out of the read buffer like `next`, receiving from `socket` until one is
+    // complete. Returns false if the connection closed first
+    bool read(InternetSocket &socket, MulticastMessageHeader &header, Buffer &body);
+
+  private:
+    // Returns the number of bytes of the frame at the front of the read buffer that have not been
+    // received yet, or 0 if it is complete
+    size_t missing_() const;
+
+    // Moves the unread bytes to the front of the read buffer and grows it, so that there is room
+    // for at least one more read and for the rest of the frame at the front
+    void reserve_();
+
+    // The number of bytes received at a time
+    size_t read_size_;
+
+    // The largest frame, header included, that is accepted
+    size_t max_frame_size_;
+
+    // The read buffer
+    std::vector<char> data_;
+
+    // The offset of the first byte that has not been handed out yet
+    size_t begin_;
+
+    // The offset just past the last byte that was received
+    size_t end_;
+};
@@ -0,0 +1,77 @@
+// File: include/group_table.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Tracks which participants subscribe to each named group
+//
+// Every group keeps a compact list of its subscribers, so a message addressed to a group is fanned
+// out by walking that list instead of every participant. Each subscription also keeps the sequence
+// number of the last message of its group that was delivered to the participant before it stopped
+// receiving them, so that what a participant missed is tracked separately for every group.
+//
+// Note: The table must only be changed from one thread at a time
+class GroupTable {
+  public:
+    // Constructs a table in which nobody subscribes to any group
+    GroupTable() = default;
+
+    // Makes this table non-copyable and non-copy-assignable
+    GroupTable(GroupTable &other) = delete;
+    GroupTable &operator=(GroupTable &other) = delete;
+
+    // Subscribes participant `pid` to `group`
+    //
+    // Returns false if it already was
+    bool subscribe(uint32_t group, uint16_t pid);
+
+    // Unsubscribes participant `pid` from `group`
+    //
+    // Returns false if it was not subscribed
+    bool unsubscribe(uint32_t group, uint16_t pid);
+
+    // Returns every participant that subscribes to `group`, in no particular order
+    //
+    // Note: The list is only valid until the table changes
+    const std::vector<uint16_t> &subscribers(uint32_t group) const;
+
+    // Returns every group that participant `pid` subscribes to, in no particular order
+    //
+    // Note: The list is only valid until the table changes
+    const std::vector<uint32_t> &groups(uint16_t pid) const;
+
+    // Records that participant `pid` was delivered every message of `group` up to number `sequence`
+    // in the group's order before it stopped receiving them
+    void set_sequence(uint32_t group, uint16_t pid, uint64_t sequence);
+
+    // Returns the sequence number of the last message of `group` that was delivered to participant
+    // `pid` before it stopped receiving them
+    uint64_t sequence(uint32_t group, uint16_t pid) const;
+
+  private:
+    // Represents everything known about the subscribers of one group
+    struct Group {
+        // The pid of every subscriber
+        std::vector<uint16_t> subscribers;
+
+        // The sequence number of the last message of the group delivered to each subscriber before
+        // it stopped receiving them
+        // Key: pid
+        // Val: sequence number
+        std::unordered_map<uint16_t, uint64_t> sequences;
+    };
+
+    // Every group that has at least one subscriber
+    // Key: group id
+    // Val: group
+    std::unordered_map<uint32_t, Group> groups_;
+
+    // The groups that every participant with at least one subscription subscribes to
+    // Key: pid
+    // Val: group ids
+    std::unordered_map<uint16_t, std::vector<uint32_t>> subscriptions_;
+};
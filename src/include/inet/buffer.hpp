@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,9 +19,22 @@ class Buffer {
     // Constructs a buffer using the given string
     Buffer(std::string data);
 
-    // Constructs a buffer of the given size
+    // Constructs a buffer of the given size, whose memory is taken from the `BufferPool` and is
+    // reference-counted, so that several buffers made with `share` can refer to it at once. The
+    // memory goes back to the pool along with the last buffer that refers to it
+    //
+    // Note: The contents of a shared buffer must not be modified once it has been shared
     Buffer(size_t size);
 
+    // Constructs a buffer of the given size that is meant to be shared, which is the same as
+    // `Buffer(size)`
+    static Buffer make_shared(size_t size);
+
+    // Returns a buffer that refers to the same memory as this buffer without copying it
+    //
+    // Note: If this buffer does not own its memory, the result holds a copy from the pool
+    Buffer share() const;
+
     // Makes this buffer non-copyable and non-copy-assignable
     Buffer(Buffer &other) = delete;
     Buffer &operator=(Buffer &other) = delete;
@@ -50,6 +64,7 @@ class Buffer {
     // The size of the underlying data of this buffer
     size_t size_;
 
-    // True if this buffer is responsible for allocating and deallocating the buffer
-    bool owns_data_;
+    // The pooled memory that this buffer holds a reference to, or nullptr if it does not own its
+    // memory
+    char *block_;
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+// File: include/inet/buffer_pool.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <cstddef>
+
+// Hands out the memory behind owning buffers, so that the frames sent and received in a steady
+// stream of messages are recycled instead of going back to the heap every time
+//
+// Requests are rounded up to one of `SIZE_CLASSES` block sizes, each twice the one before. Every
+// thread keeps its own free list of blocks for each size, so allocating and recycling a block takes
+// no lock. A thread that recycles more blocks than it keeps (such as a delivery worker freeing the
+// frames that a shard allocated) hands half of them to a central list, which threads whose own list
+// runs dry take blocks from before carving new ones out of a slab from the heap. Slabs are kept for
+// the life of the process, so the pool only ever grows to the most blocks that were in use at once.
+// Requests larger than `MAX_BLOCK_SIZE` are allocated on their own and freed once released.
+//
+// Every block is reference-counted, so that several buffers can share it.
+class BufferPool {
+  public:
+    // The smallest block size
+    static const size_t MIN_BLOCK_SIZE = 64;
+
+    // The number of block sizes
+    static const size_t SIZE_CLASSES = 15;
+
+    // The largest block size, above which requests are not pooled
+    static const size_t MAX_BLOCK_SIZE = MIN_BLOCK_SIZE << (SIZE_CLASSES - 1);
+
+    // Returns memory for at least `size` bytes, which is released once its one reference is
+    static char *allocate(size_t size);
+
+    // Adds a reference to `data`, which was returned by `allocate`
+    static void retain(char *data);
+
+    // Drops a reference to `data`, which was returned by `allocate`, recycling it along with the
+    // last reference
+    static void release(char *data);
+};
@@ -0,0 +1,63 @@
+// File: include/inet/event_loop.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "internet_socket.hpp"
+
+// Represents a change in the state of a socket that is registered with an `EventLoop`
+struct LoopEvent {
+    // The token that the socket was registered with
+    uint64_t token;
+
+    // True if data may be read from the socket (or a connection may be accepted on it)
+    bool readable;
+
+    // True if data may be written to the socket
+    bool writeable;
+
+    // True if the remote end hung up or the socket is in an error state
+    bool closed;
+};
+
+// Represents an edge-triggered epoll instance that waits on many sockets at once
+//
+// Note: Since notifications are edge-triggered, a socket is only reported again after it changes
+//       state, so callers must read (or write) until a transfer would block
+class EventLoop {
+  public:
+    // Creates an epoll instance
+    EventLoop();
+
+    // Makes this event loop non-copyable and non-copy-assignable
+    EventLoop(EventLoop &other) = delete;
+    EventLoop &operator=(EventLoop &other) = delete;
+
+    // Cleans up the resources associated with this event loop
+    ~EventLoop();
+
+    // Registers `socket` for read and write notifications, which will be reported with `token`
+    void do_add(InternetSocket &socket, uint64_t token);
+
+    // Stops notifying about changes to the state of `socket`
+    void do_remove(InternetSocket &socket);
+
+    // Waits up to `timeout` milliseconds (or indefinitely if `timeout` < 0) for registered sockets
+    // to change state, replacing the contents of `events` with the changes that occured
+    //
+    // Note: Returns early, possibly with no events, if `do_wake` is called from another thread
+    void do_wait(std::vector<LoopEvent> &events, int timeout);
+
+    // Wakes up the thread that is currently blocked in `do_wait`
+    void do_wake();
+
+  private:
+    // The file descriptor that identifies the epoll instance
+    int epoll_fd_;
+
+    // The file descriptor of the eventfd used to wake up `do_wait`
+    int wake_fd_;
+};
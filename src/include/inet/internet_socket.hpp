@@ -5,6 +5,7 @@
 
 #include <netinet/in.h>
 
+#include <chrono>
 #include <limits>
 #include <string>
 #include <vector>
@@ -46,6 +47,9 @@ class InternetAddress {
 // Represents information about a socket that is being polled for its state
 struct PollInfo;
 
+// Represents the outcome of a non-blocking transfer on a socket
+struct TransferInfo;
+
 // Represents an IPv4 TCP socket
 class InternetSocket {
   public:
@@ -70,12 +74,42 @@ class InternetSocket {
     // port `remote_port`
     void do_connect(std::string remote_addr, uint16_t remote_port);
 
+    // Connects to the already resolved `remote_addr`, returning false instead of exiting if the
+    // connection could not be established
+    bool try_connect(InternetAddress remote_addr);
+
     // Prompts this socket to listen for incoming connections with a backlog of size `backlog_size`
     void do_listen(size_t backlog_size);
 
     // Accepts the next waiting connection and returns its associated socket
     InternetSocket do_accept();
 
+    // Accepts the next waiting connection without blocking and returns its associated non-blocking
+    // socket, or an invalid socket if no connection is waiting. If there is one but the process ran
+    // out of file descriptors or memory for it, `exhausted` (if given) is set to true and the
+    // connection is left waiting
+    InternetSocket try_accept(bool *exhausted = nullptr);
+
+    // Puts this socket into non-blocking mode, so that transfers on it never wait
+    void do_set_nonblocking();
+
+    // Lets other sockets that also set this option bind to the same port, with the kernel spreading
+    // incoming connections across their listeners
+    //
+    // Note: Must be called before `do_bind`
+    void do_set_reuseport();
+
+    // Sends small writes as soon as they are made rather than holding them back until earlier
+    // writes are acknowledged, which would stall request-response traffic on delayed ACKs
+    void do_set_nodelay();
+
+    // Makes a blocking send on this socket give up with EAGAIN once it has waited `timeout` for the
+    // remote end to make room, so that a peer which stops reading cannot hold the sender forever
+    void do_set_send_timeout(std::chrono::milliseconds timeout);
+
+    // Returns true if this socket refers to an open OS socket
+    bool is_valid() const;
+
     // Returns the number of bytes of `buffer` that were successfully sent to the remote end of the
     // connection
     size_t do_send(const Buffer &data, int flags = 0);
@@ -84,6 +118,25 @@ class InternetSocket {
     // bytes are sent
     void do_sendall(const Buffer &data, int flags = 0);
 
+    // Sends all of the bytes of `buffer` to the remote end of the connection, blocking until all
+    // bytes are sent. Returns false instead of exiting (or raising SIGPIPE) if the connection broke
+    bool try_sendall(const Buffer &data);
+
+    // Sends all of the bytes of every buffer in `data`, in order, as if they were one contiguous
+    // buffer, blocking until all bytes are sent
+    void do_sendv(const std::vector<Buffer> &data);
+
+    // Sends all of the bytes of every buffer in `data`, in order, blocking until all bytes are
+    // sent. Returns false instead of exiting (or raising SIGPIPE) if the connection broke
+    bool try_sendv(const std::vector<Buffer> &data);
+
+    // Sends as many bytes of `data` as can be sent without blocking on a non-blocking socket
+    TransferInfo try_send(const Buffer &data);
+
+    // Receives as many bytes into `data` as are available without blocking on a non-blocking
+    // socket, stopping once `data` is full
+    TransferInfo try_recv(Buffer &data);
+
     // Possibly returns a `Buffer` containing up to `max_bytes_expected` bytes of data received from
     // the remote end of the connection
     size_t do_recv(Buffer &data, int flags = 0);
@@ -129,6 +182,8 @@ class InternetSocket {
     PollInfo do_poll(PollInfo request, size_t timeout);
 
   private:
+    friend class EventLoop;
+
     // Used to construct remote sockets
     InternetSocket(int file_desc, InternetAddress host_addr, InternetAddress remote_addr);
 
@@ -164,4 +219,15 @@ struct PollInfo {
     // On input:  True when the caller wants to know if the socket is readable
     // On output: True if data may be written to the socket
     bool writeable;
-};
\ No newline at end of file
+};
+
+struct TransferInfo {
+    // The number of bytes that were transferred
+    size_t bytes;
+
+    // True if the transfer stopped because it would have had to block
+    bool would_block;
+
+    // True if the remote end closed the connection or the connection broke
+    bool closed;
+};
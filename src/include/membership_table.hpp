@@ -0,0 +1,123 @@
+// File: include/membership_table.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Represents where a participant stands with the multicast group
+enum class MemberState : uint8_t {
+    // Not registered
+    UNREGISTERED = 0,
+
+    // Registered and receiving multicast messages
+    CONNECTED,
+
+    // Registered, but missing multicast messages until it reconnects
+    DISCONNECTED
+};
+
+// Tracks every participant of the multicast group in one table indexed directly by pid
+//
+// Each field of a member lives in its own array (struct-of-arrays), so looking a member up is a
+// single index rather than a hash lookup. The pids of connected members are also kept in a
+// compact list, so fanning a message out walks only the connected members and changing the table
+// never copies the list.
+//
+// A table may be limited to every `stride`-th pid (the pids that one coordinator shard owns), in
+// which case its arrays only have room for those pids.
+//
+// Note: The table must only be changed from one thread at a time
+class MembershipTable {
+  public:
+    // Constructs a table in which no participant is registered, that holds the pids which leave
+    // the same remainder when divided by `stride`
+    explicit MembershipTable(size_t stride = 1);
+
+    // Makes this table non-copyable and non-copy-assignable
+    MembershipTable(MembershipTable &other) = delete;
+    MembershipTable &operator=(MembershipTable &other) = delete;
+
+    // Registers participant `pid`, connected and listening at `ip`:`port`
+    void add(uint16_t pid, std::string ip, uint16_t port);
+
+    // Deregisters participant `pid`
+    void remove(uint16_t pid);
+
+    // Marks participant `pid` as connected again, now listening on `port`
+    void connect(uint16_t pid, uint16_t port);
+
+    // Marks participant `pid` as having disconnected at `disconnect_time`, after being delivered
+    // every message up to number `sequence` in the group's order
+    void disconnect(uint16_t pid, time_t disconnect_time, uint64_t sequence);
+
+    // Returns where participant `pid` stands with the group
+    MemberState state(uint16_t pid) const;
+
+    // Returns the IP address that participant `pid` registered from
+    const std::string &ip(uint16_t pid) const;
+
+    // Returns the port that participant `pid` listens on
+    uint16_t port(uint16_t pid) const;
+
+    // Returns when participant `pid` disconnected (DISCONNECTED only)
+    time_t disconnect_time(uint16_t pid) const;
+
+    // Returns the sequence number of the last message delivered to participant `pid` before it
+    // disconnected (DISCONNECTED only)
+    uint64_t sequence(uint16_t pid) const;
+
+    // Returns the number of participants that are disconnected
+    size_t disconnected_count() const;
+
+    // Returns the pids of every connected participant, in no particular order
+    //
+    // Note: The list changes along with the table, and must only be read by the thread that changes
+    //       it. Disconnecting or removing a participant moves the last pid of the list into its
+    //       place, so a list that is walked from the back may lose the pid being visited without
+    //       skipping any other
+    const std::vector<uint16_t> &connected() const;
+
+  private:
+    // Returns the index of participant `pid` in the arrays of this table
+    size_t slot_(uint16_t pid) const;
+
+    // Adds `pid` to the list of connected participants
+    void link_(uint16_t pid);
+
+    // Removes `pid` from the list of connected participants
+    void unlink_(uint16_t pid);
+
+    // The number of pids that can be represented
+    static const size_t PID_COUNT = UINT16_MAX + 1;
+
+    // The distance between the pids that this table holds
+    size_t stride_;
+
+    // Where each participant stands with the group
+    std::vector<MemberState> states_;
+
+    // The IP address each participant registered from
+    std::vector<std::string> ips_;
+
+    // The port each participant listens on
+    std::vector<uint16_t> ports_;
+
+    // When each disconnected participant disconnected
+    std::vector<time_t> disconnect_times_;
+
+    // The sequence number of the last message delivered to each disconnected participant
+    std::vector<uint64_t> sequences_;
+
+    // The index of each connected participant in `connected_list_`
+    std::vector<uint32_t> connected_slots_;
+
+    // The pids of every connected participant, in no particular order
+    std::vector<uint16_t> connected_list_;
+
+    // The number of participants that are disconnected
+    size_t disconnected_count_;
+};
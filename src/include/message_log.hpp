@@ -0,0 +1,217 @@
+// File: include/message_log.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "inet/buffer.hpp"
+
+// Stores multicast messages for disconnected participants in a single append-only binary log
+//
+// Every message is written to the log once, however many participants are disconnected. Each
+// disconnected participant has a cursor, the offset of the first message it missed, and receives
+// every message from its cursor onwards when it reconnects. A cursor only needs the messages that
+// arrive before its participant's persistence window closes, so once the window has closed the
+// cursor ends at the end of the log. The log is split into segment files that are deleted as soon
+// as they hold nothing that an open range of a cursor (or a hold) refers to, which bounds the
+// size of the log by the persistence window rather than by how long participants stay away.
+//
+// Each record in the log is the size of a frame (as a little-endian uint32) followed by the frame.
+// The log also keeps an in-memory index from the sequence number of every record to its offset and
+// arrival time, so a participant can resume right after the last message it saw, and a cursor
+// restored after the coordinator restarts ends where its window closed.
+class MessageLog {
+  public:
+    // Represents the records that a disconnected participant needs
+    struct Cursor {
+        // The offset of the first record the participant missed
+        uint64_t from;
+
+        // The offset just past the last record the participant needs, or `OPEN` while the
+        // participant's window has not closed yet
+        uint64_t to;
+
+        // When the participant's window closes
+        time_t expires_at;
+    };
+
+    // Opens the log whose segments are stored in `directory` and rolled over once they reach
+    // `segment_size` bytes, picking up every record in the segments that a previous coordinator
+    // left there and starting a new segment after them
+    //
+    // Note: The segments left behind are deleted by the next compaction unless cursors that refer
+    //       to them are restored first
+    MessageLog(std::string directory, size_t segment_size = DEFAULT_SEGMENT_SIZE);
+
+    // Makes this log non-copyable and non-copy-assignable
+    MessageLog(MessageLog &other) = delete;
+    MessageLog &operator=(MessageLog &other) = delete;
+
+    // Closes the active segment
+    ~MessageLog();
+
+    // The size that segments are rolled over at when none is given
+    static const size_t DEFAULT_SEGMENT_SIZE = 16 * 1024 * 1024;
+
+    // Appends a record holding the serialized message `frame`, which arrived at `arrived_at` and is
+    // number `sequence` in the group's order, to the end of the log, first ending every cursor whose
+    // window closed before then
+    //
+    // Note: Records must be appended in increasing order of their sequence numbers
+    //
+    // Returns false without storing `frame` if no cursor needs it
+    bool append(const Buffer &frame, time_t arrived_at, uint64_t sequence);
+
+    // Returns the offset just past the last record in the log
+    uint64_t end_offset();
+
+    // Returns the offset of the first record whose sequence number comes after `sequence`, or the
+    // end of the log if there is none
+    uint64_t seek(uint64_t sequence);
+
+    // Places a cursor for participant `pid` at the end of the log, which needs every record appended
+    // until `expires_at`, and returns its offset
+    uint64_t open_cursor(uint16_t pid, time_t expires_at);
+
+    // Places a cursor for participant `pid` at `from`, which needs every record appended until
+    // `expires_at`, as the cursor was before the coordinator restarted
+    void restore_cursor(uint16_t pid, uint64_t from, time_t expires_at);
+
+    // Copies the cursor of participant `pid` into `cursor`
+    //
+    // Returns false if participant `pid` has no cursor
+    bool find_cursor(uint16_t pid, Cursor &cursor);
+
+    // Returns the offset just past the last record that the cursor of participant `pid` needs
+    uint64_t cursor_end(uint16_t pid);
+
+    // Removes the cursor of participant `pid` and deletes every segment no cursor refers to anymore
+    void close_cursor(uint16_t pid);
+
+    // Returns the number of bytes of records stored so far for every participant with a cursor
+    // Key: pid
+    // Val: bytes of records from its cursor onwards
+    std::map<uint16_t, uint64_t> backlogs();
+
+    // Keeps every record from `from` up to `to` from being deleted, like a cursor that does not
+    // belong to any participant, and returns a token that identifies the hold
+    uint64_t retain(uint64_t from, uint64_t to);
+
+    // Removes the hold identified by `token` and deletes every segment no cursor refers to anymore
+    void release(uint64_t token);
+
+    // Ends every cursor whose window closed by `now` and deletes every segment that is no longer
+    // needed, returning the number of bytes that were deleted
+    uint64_t compact(time_t now);
+
+    // Returns the number of bytes that have been deleted from the log so far
+    uint64_t reclaimed_bytes();
+
+    // Calls `visit` with every frame whose record starts at or after `from` and before `to`, in the
+    // order they were appended
+    //
+    // Note: The segments are memory-mapped and walked without holding the log's lock, so the records
+    //       from `from` onwards must be held by a cursor or `retain` until this returns. `frame`
+    //       points into the mapping of its segment, which stays valid until `unmapping` is called
+    //       once that segment has been walked
+    void read(uint64_t from, uint64_t to, std::function<void(const char *frame, size_t size)> visit,
+              std::function<void()> unmapping = nullptr);
+
+  private:
+    // Represents one file of the log
+    struct Segment {
+        // The path of the segment file
+        std::string path;
+
+        // The number of bytes in the segment
+        uint64_t size;
+    };
+
+    // Represents records that are being read and must not be deleted
+    struct Hold {
+        // The offset of the first record being held
+        uint64_t from;
+
+        // The offset just past the last record being held
+        uint64_t to;
+    };
+
+    // Represents where a record is in the log
+    struct IndexEntry {
+        // The sequence number of the record's message
+        uint64_t sequence;
+
+        // The offset of the record
+        uint64_t offset;
+
+        // When the record's message arrived at the coordinator
+        time_t arrived_at;
+    };
+
+    // Marks a range that reaches however far the log grows
+    static const uint64_t OPEN = UINT64_MAX;
+
+    // Returns the offset just past the last record in the log
+    uint64_t end_();
+
+    // Ends every cursor whose window closed before `now` at the end of the log
+    void expire_(time_t now);
+
+    // Picks up every segment in the directory and indexes its records, cutting off a record that
+    // was only partly written when the coordinator stopped
+    void recover_();
+
+    // Closes the active segment and starts a new one at the end of the log
+    void roll_();
+
+    // Deletes every segment that holds no record that a cursor or hold refers to, returning the
+    // number of bytes that were deleted
+    uint64_t collect_();
+
+    // Returns the path of the segment that starts at `base_offset`
+    std::string segment_path_(uint64_t base_offset);
+
+    // The directory that the segments are stored in
+    std::string directory_;
+
+    // The size at which the active segment is rolled over
+    size_t segment_size_;
+
+    // Guards every member below
+    std::mutex lock_;
+
+    // Every segment of the log, the last of which is the active segment being appended to
+    // Key: offset of the first record in the segment
+    // Val: segment
+    std::map<uint64_t, Segment> segments_;
+
+    // The file descriptor of the active segment
+    int active_fd_;
+
+    // The cursor of every disconnected participant
+    // Key: pid
+    // Val: cursor
+    std::unordered_map<uint16_t, Cursor> cursors_;
+
+    // Every hold placed by `retain`
+    // Key: token
+    // Val: hold
+    std::unordered_map<uint64_t, Hold> holds_;
+
+    // The sequence number and offset of every record, in order, from the first segment onwards
+    std::deque<IndexEntry> index_;
+
+    // The number of bytes that have been deleted from the log so far
+    uint64_t reclaimed_bytes_ = 0;
+
+    // The token that will identify the next hold
+    uint64_t next_hold_token_ = 0;
+};
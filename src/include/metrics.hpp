@@ -0,0 +1,264 @@
+// File: include/metrics.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The number of slots that every metric is spread over, so that threads rarely share one
+static const size_t METRIC_SLOTS = 16;
+
+// Returns the slot that the calling thread records its metrics in
+//
+// Threads are handed slots in the order they first record something, so a process with no more
+// than `METRIC_SLOTS` threads never has two threads writing to the same slot
+inline size_t metric_slot() {
+    static std::atomic<size_t> next_slot(0);
+    static thread_local size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed) % METRIC_SLOTS;
+    return slot;
+}
+
+// Counts events, such as requests handled or bytes sent, from any number of threads
+//
+// Each thread adds to its own cache line, so recording is one uncontended atomic add, and the total
+// is only summed up when it is read.
+class Counter {
+  public:
+    // Constructs a counter at 0
+    Counter() = default;
+
+    // Makes this counter non-copyable and non-copy-assignable
+    Counter(Counter &other) = delete;
+    Counter &operator=(Counter &other) = delete;
+
+    // Adds `amount` to the counter
+    void add(uint64_t amount = 1) {
+        slots_[metric_slot()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    // Returns the sum of everything added so far
+    uint64_t value() const;
+
+  private:
+    // The part of the count added by the threads of one slot, alone on its cache line
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value {0};
+    };
+
+    // The part of the count added by the threads of each slot
+    Slot slots_[METRIC_SLOTS];
+};
+
+// Represents the values that a `Histogram` recorded up to some point
+struct HistogramSnapshot {
+    // The number of values recorded
+    uint64_t count = 0;
+
+    // The sum of the values recorded
+    uint64_t sum = 0;
+
+    // The number of values recorded in each bucket
+    std::vector<uint64_t> buckets;
+
+    // Returns the mean of the values recorded, or 0 if there are none
+    double mean() const;
+
+    // Returns the highest value that shares a bucket with the value that `fraction` (from 0 to 1)
+    // of the values recorded are at or below, or 0 if there are none
+    uint64_t percentile(double fraction) const;
+};
+
+// Records the distribution of values, such as latencies in nanoseconds, from any number of threads
+//
+// Values are counted in log-linear buckets, like an HDR histogram: every power of two is split into
+// `SUB_BUCKETS` equal buckets, so every value is known to within 1 / `SUB_BUCKETS` of itself
+// whatever its magnitude, with a fixed number of buckets and no allocation while recording. Each
+// thread counts into its own set of buckets, which are only summed up when a snapshot is taken.
+class Histogram {
+  public:
+    // The number of bits of a value, after its leading bit, that pick its bucket
+    static const size_t SUB_BUCKET_BITS = 4;
+
+    // The number of buckets that each power of two is split into
+    static const size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    // The number of buckets, which covers every uint64 value
+    static const size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    // Constructs a histogram with nothing recorded
+    Histogram();
+
+    // Makes this histogram non-copyable and non-copy-assignable
+    Histogram(Histogram &other) = delete;
+    Histogram &operator=(Histogram &other) = delete;
+
+    // Records `value`
+    void record(uint64_t value) {
+        Slot &slot = slots_[metric_slot()];
+        slot.buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        slot.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // Returns what has been recorded so far
+    HistogramSnapshot snapshot() const;
+
+    // Returns the bucket that `value` is counted in
+    static size_t bucket(uint64_t value) {
+        if (value < SUB_BUCKETS) return value;
+        size_t exponent = 63 - __builtin_clzll(value);
+        size_t shift    = exponent - SUB_BUCKET_BITS;
+        return ((shift + 1) << SUB_BUCKET_BITS) + ((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    // Returns the highest value that is counted in `bucket`
+    static uint64_t bucket_limit(size_t bucket);
+
+  private:
+    // The buckets of the threads of one slot, starting on their own cache line
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sum {0};
+        std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    };
+
+    // The buckets of the threads of each slot
+    std::unique_ptr<Slot[]> slots_;
+};
+
+// Records how long it is alive for, in nanoseconds, in a histogram
+class ScopedTimer {
+  public:
+    // Starts timing for `histogram`
+    explicit ScopedTimer(Histogram &histogram) :
+        histogram_(histogram), started_(std::chrono::steady_clock::now()) {}
+
+    // Records the time since construction
+    ~ScopedTimer() {
+        histogram_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - started_)
+                              .count());
+    }
+
+    // Makes this timer non-copyable and non-copy-assignable
+    ScopedTimer(ScopedTimer &other) = delete;
+    ScopedTimer &operator=(ScopedTimer &other) = delete;
+
+  private:
+    // Where the time is recorded
+    Histogram &histogram_;
+
+    // When timing started
+    std::chrono::steady_clock::time_point started_;
+};
+
+// Holds every metric of the process by name
+//
+// Looking a metric up takes a lock, so code on a hot path looks its metrics up once and keeps the
+// references, which stay valid for the life of the process.
+class MetricsRegistry {
+  public:
+    // Constructs a registry with no metrics
+    MetricsRegistry() = default;
+
+    // Makes this registry non-copyable and non-copy-assignable
+    MetricsRegistry(MetricsRegistry &other) = delete;
+    MetricsRegistry &operator=(MetricsRegistry &other) = delete;
+
+    // Returns the counter called `name`, creating it if there is none
+    Counter &counter(const std::string &name);
+
+    // Returns the histogram called `name`, creating it if there is none
+    Histogram &histogram(const std::string &name);
+
+    // Returns one line for every metric, counters first and then histograms, each in order of name:
+    // `<name> <value>` for counters, and `<name> count=... mean=... p50=... p90=... p99=...
+    // p999=... max=...` for histograms
+    std::string report() const;
+
+  private:
+    // Guards `counters_` and `histograms_`
+    mutable std::mutex lock_;
+
+    // Every counter
+    // Key: name
+    // Val: counter
+    std::map<std::string, std::unique_ptr<Counter>> counters_;
+
+    // Every histogram
+    // Key: name
+    // Val: histogram
+    std::map<std::string, std::unique_ptr<Histogram>> histograms_;
+};
+
+// Returns the registry that holds every metric of this process
+MetricsRegistry &metrics();
+
+// Rewrites a file from a background thread once every `interval`, with whatever its contents
+// function returns at the time
+//
+// The contents are written to a temporary file that is renamed over `path`, so readers never see a
+// file that is only partly written.
+class PeriodicFileWriter {
+  public:
+    // Returns what the file should hold now, or nothing to leave it as it is
+    using Contents = std::function<std::optional<std::string>()>;
+
+    // Starts rewriting `path` with what `contents` returns
+    PeriodicFileWriter(std::string path, std::chrono::milliseconds interval, Contents contents);
+
+    // Rewrites the file one last time and stops
+    ~PeriodicFileWriter();
+
+    // Makes this writer non-copyable and non-copy-assignable
+    PeriodicFileWriter(PeriodicFileWriter &other) = delete;
+    PeriodicFileWriter &operator=(PeriodicFileWriter &other) = delete;
+
+  private:
+    // The loop run by the background thread
+    void run_();
+
+    // Rewrites `path_` with what `contents_` returns
+    void write_();
+
+    // The file that is rewritten
+    std::string path_;
+
+    // How long to wait between rewrites
+    std::chrono::milliseconds interval_;
+
+    // Returns what the file should hold
+    Contents contents_;
+
+    // True when the background thread should rewrite the file one last time and stop
+    bool stopping_;
+
+    // Used to wake up the background thread when stopping
+    std::mutex lock_;
+    std::condition_variable stop_cv_;
+
+    // The background thread
+    std::thread worker_;
+};
+
+// How often a `StatsWriter` writes a report when no interval is configured
+static const std::chrono::seconds DEFAULT_STATS_INTERVAL(10);
+
+// Writes the report of every metric to a file from a background thread, once every `interval`,
+// replacing the report it wrote before
+class StatsWriter : public PeriodicFileWriter {
+  public:
+    // Starts writing reports to `path`, each followed by what `extra` returns (if given)
+    StatsWriter(std::string path, std::chrono::milliseconds interval,
+                std::function<std::string()> extra = nullptr);
+};
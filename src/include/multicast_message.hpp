@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <deque>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -27,21 +29,168 @@ enum class MulticastMessageType : uint8_t {
     PARTICIPANT_QUIT,
 
     // Multicasted Message
-    MULTI_MESSAGE
+    MULTI_MESSAGE,
+
+    // Several multicasted messages packed into one frame (see `MulticastBatch`)
+    MULTI_MESSAGE_BATCH,
+
+    // Tells a participant that the coordinator disconnected it for falling too far behind
+    PARTICIPANT_EVICTED,
+
+    // Asks the coordinator for its metrics, which it answers with in the body of the ACK
+    PARTICIPANT_STATS,
+
+    // Subscribes to or unsubscribes from the named group in the body
+    PARTICIPANT_SUBSCRIBE,
+    PARTICIPANT_UNSUBSCRIBE
 };
 
+// Returns the name of `type`, as it is printed in logs
+std::string type_name(MulticastMessageType type);
+
+// The number of bytes that prefix each frame stored in a batch or in the message log, holding the
+// size of the frame as a little-endian uint32
+static const size_t FRAME_PREFIX_SIZE = sizeof(uint32_t);
+
+// The largest frame, header included, that a coordinator accepts when no limit is configured
+static const size_t DEFAULT_MAX_FRAME_SIZE = 1024 * 1024;
+
+// Writes the prefix of a frame of `frame_size` bytes to `prefix`
+void encode_frame_prefix(unsigned char *prefix, uint32_t frame_size);
+
+// Returns the frame size stored in `prefix`
+uint32_t decode_frame_prefix(const unsigned char *prefix);
+
+// The version of the wire format that this build speaks
+//
+// Only requests and their acknowledgements are encoded with the version agreed on when registering,
+// which the coordinator checks every request against. Multicast messages, batches and replays are
+// encoded once for every recipient, so they are always sent with `PROTOCOL_VERSION`, and a
+// participant reads them whatever version it agreed to. The layout of a header only depends on its
+// flags, and the flags that need more than `MIN_PROTOCOL_VERSION` are kept from participants that
+// did not agree to them: group messages only reach subscribers, which need `GROUP_VERSION`, and
+// compressed bodies only reach participants that offered to read them.
+static const uint8_t PROTOCOL_VERSION = 3;
+
+// The oldest version of the wire format that this build still accepts
+static const uint8_t MIN_PROTOCOL_VERSION = 1;
+
+// Set in the flags of a header that carries a sequence number
+static const uint8_t HEADER_FLAG_SEQUENCE = 0x01;
+
+// Set in the flags of a header that carries the time its message arrived at the coordinator
+static const uint8_t HEADER_FLAG_TIME = 0x02;
+
+// Set in the flags of a header whose body is compressed (see `compress_payload`). On a REGISTER it
+// instead says that the participant can read compressed bodies, and on the ACK of a REGISTER that
+// the coordinator accepts them
+static const uint8_t HEADER_FLAG_COMPRESSED = 0x04;
+
+// Set in the flags of a request that carries a request id, which the coordinator copies into the
+// header of its answer so that answers can be matched to pipelined requests
+static const uint8_t HEADER_FLAG_REQUEST_ID = 0x08;
+
+// Set in the flags of a chunk of a message that was too large for one frame, when more chunks of
+// the same message follow it
+static const uint8_t HEADER_FLAG_MORE_CHUNKS = 0x10;
+
+// Set in the flags of a chunk of a message that was too large for one frame, when it continues the
+// previous chunk from the same participant
+//
+// Each chunk is sent, numbered and delivered as a message of its own, so the coordinator forwards
+// every chunk as soon as it arrives and never holds more than one chunk of a message. Recipients
+// gather the chunks of a participant's message until the last one, which has only this flag.
+static const uint8_t HEADER_FLAG_CONTINUATION = 0x20;
+
+// Set in the flags of an msend or multicast message that is addressed to a named group rather than
+// to every participant, which carries the id of that group (see `group_id`)
+//
+// Named groups are numbered on their own, so the sequence number of such a message is its position
+// in its group's order, and every other message keeps its number in the order of the whole group.
+static const uint8_t HEADER_FLAG_GROUP = 0x40;
+
+// The oldest version of the wire format whose headers may carry a request id
+static const uint8_t REQUEST_ID_VERSION = 2;
+
+// The oldest version of the wire format that has named groups
+static const uint8_t GROUP_VERSION = 3;
+
+// The longest name a group may have
+static const size_t MAX_GROUP_NAME_SIZE = 64;
+
+// Returns the id that the group named `name` is addressed by on the wire, which is never 0
+//
+// Note: Distinct names may share an id, which the coordinator detects when they are subscribed to
+uint32_t group_id(const std::string &name);
+
+// Describes the message that follows it on the wire
+//
+// Headers are encoded field by field rather than copied, so their layout does not depend on the
+// compiler or architecture. Every field is little-endian:
+//
+//   offset  size  field
+//   0       1     version
+//   1       1     type
+//   2       1     flags
+//   3       2     pid
+//   5       4     size of the body
+//   9       8     sequence number (only if HEADER_FLAG_SEQUENCE is set)
+//   9/17    4     coordinator time, in seconds since the epoch (only if HEADER_FLAG_TIME is set)
+//   9-21    4     request id (only if HEADER_FLAG_REQUEST_ID is set)
+//   9-25    4     group id (only if HEADER_FLAG_GROUP is set)
+//
+// The first `BASE_SIZE` bytes are laid out the same way by every version, so that a peer can always
+// read enough of a header to learn its version and size.
 struct MulticastMessageHeader {
+    // The version of the wire format the message is encoded with
+    uint8_t version = PROTOCOL_VERSION;
+
     // The type of the message being transmitted
-    MulticastMessageType type;
+    MulticastMessageType type = MulticastMessageType::INVALID;
+
+    // Which of the optional fields follow the fixed ones (see `HEADER_FLAG_*`)
+    uint8_t flags = 0;
 
     // Participant ID
-    uint16_t pid;
+    uint16_t pid = 0;
+
+    // The size of the body of the message being transmitted, excluding the header
+    uint32_t size = 0;
+
+    // The position of the message in the group's order (only if HEADER_FLAG_SEQUENCE is set)
+    uint64_t sequence = 0;
+
+    // Time message arrives at coordinator (only if HEADER_FLAG_TIME is set)
+    time_t coordinator_time = 0;
 
-    // The total size of the message being transmitted, including the header
-    uint32_t size;
+    // The request this message is, or answers (only if HEADER_FLAG_REQUEST_ID is set)
+    uint32_t request_id = 0;
 
-    // Time message arrives at coordinator
-    time_t coordinator_time;
+    // The named group the message is addressed to (only if HEADER_FLAG_GROUP is set)
+    uint32_t group = 0;
+
+    // The number of bytes of the fields that every header has
+    static constexpr size_t BASE_SIZE = 9;
+
+    // The most bytes that a header can take up
+    static constexpr size_t MAX_SIZE =
+        BASE_SIZE + sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t);
+
+    // Returns the number of bytes this header takes up on the wire
+    size_t encoded_size() const;
+
+    // Writes this header to `data`, which must have room for `encoded_size()` bytes, and returns the
+    // number of bytes written
+    size_t encode(unsigned char *data) const;
+
+    // Returns the number of bytes taken up by the header at the start of the `available` bytes of
+    // `data`, or 0 if not enough of it is available to tell
+    static size_t peek_size(const unsigned char *data, size_t available);
+
+    // Reads the header at the start of the `available` bytes of `data` into `header`
+    //
+    // Returns the number of bytes read, or 0 if the whole header is not available yet
+    static size_t decode(const unsigned char *data, size_t available, MulticastMessageHeader &header);
 
     // Constructs a header from the given buffer
     static MulticastMessageHeader from_buffer(Buffer &buffer);
@@ -53,15 +202,56 @@ struct MulticastMessageHeader {
 class MulticastMessage {
   public:
     // Constructs an FTPMessage
+    //
+    // Note: Only MULTI_MESSAGE headers carry `time_sent` on the wire, since no other message needs it
     MulticastMessage(MulticastMessageType type, uint16_t pid, time_t time_sent);
 
     // Returns the header of this message
     MulticastMessageHeader header();
 
     // Returns the body of this message
-    std::string body();
+    const std::string &body();
+
+    // Returns the body of this message without copying it, leaving the message without a body
+    std::string take_body();
 
-    // Appends to the body of this message
+    // Encodes this message with version `version` of the wire format
+    void set_version(uint8_t version);
+
+    // Numbers this message `sequence` in the group's order, which is then carried in its header
+    void set_sequence(uint64_t sequence);
+
+    // Tags this request with `request_id`, which is then carried in its header
+    void set_request_id(uint32_t request_id);
+
+    // Addresses this message to the named group `group`, which is then carried in its header
+    void set_group(uint32_t group);
+
+    // Marks this message as a chunk of a larger message, setting whichever of
+    // `HEADER_FLAG_MORE_CHUNKS` and `HEADER_FLAG_CONTINUATION` are set in `chunk_flags`
+    void set_chunk_flags(uint8_t chunk_flags);
+
+    // Returns this message split into chunks whose bodies are at most `chunk_size` bytes, in the
+    // order they must be sent, or just this message if its body already fits
+    std::vector<MulticastMessage> split(size_t chunk_size);
+
+    // Sets `HEADER_FLAG_COMPRESSED` without touching the body, such as when the body is already
+    // compressed or when negotiating compression
+    void set_compressed();
+
+    // Compresses the body of this message if it is at least `threshold` bytes and compression makes
+    // it smaller
+    //
+    // Returns true if the body was compressed
+    bool compress(size_t threshold);
+
+    // Decompresses the body of this message if it is compressed
+    //
+    // Returns false if the body is compressed but could not be decompressed
+    bool decompress();
+
+    // Appends to the body of this message, taking `data` over as the body if there is none yet so
+    // that a body that is moved in is never copied
     //
     // Note: This function will update the size in the header of this message
     friend MulticastMessage &operator<<(MulticastMessage &message, std::string data);
@@ -69,10 +259,81 @@ class MulticastMessage {
     // Returns a buffer containing a serialized representation of this message
     Buffer to_buffer();
 
+    // Returns the serialized representation of this message as two views, one of its header and one
+    // of its body, which stay valid for as long as this message is not modified or destroyed
+    std::vector<Buffer> to_buffers();
+
+    // Appends the serialized representation of this message to `out`
+    void append_to(std::string &out);
+
+    // Returns a reference-counted buffer containing a serialized representation of this message,
+    // so that the one copy can be shared by everything that sends or stores it
+    Buffer to_shared_buffer();
+
   private:
     // The header that describes this message
     MulticastMessageHeader header_;
 
+    // The encoded header, which `to_buffers` returns a view of
+    unsigned char encoded_header_[MulticastMessageHeader::MAX_SIZE];
+
     // The body of this message
     std::string body_;
-};
\ No newline at end of file
+};
+
+// Packs several serialized MULTI_MESSAGE frames into a single MULTI_MESSAGE_BATCH frame
+//
+// The body of a batch is the number of entries (as a little-endian uint32) followed by the entries,
+// each of which is a frame prefixed by its size, just like the records of the message log. Frames
+// are not copied into the batch; it is serialized as a list of views to be sent with `do_sendv`.
+class MulticastBatch {
+  public:
+    // Constructs an empty batch whose serialized form may grow up to `capacity` bytes
+    explicit MulticastBatch(size_t capacity);
+
+    // Returns true if a frame of `frame_size` bytes can still be added to this batch
+    bool fits(size_t frame_size) const;
+
+    // Appends the `frame_size` bytes of `frame` to this batch without copying them
+    //
+    // Note: `frame` must stay valid until this batch is cleared
+    void add(const void *frame, size_t frame_size);
+
+    // Appends `entry`, a frame that is already prefixed by its size (such as a record of the message
+    // log), to this batch without copying it. Entries that directly follow one another in memory
+    // are sent as one view
+    //
+    // Note: `entry` must stay valid until this batch is cleared
+    void add_entry(const void *entry, size_t entry_size);
+
+    // Returns the number of frames in this batch
+    size_t count() const;
+
+    // Returns the serialized batch as a list of views, which stay valid until this batch changes
+    std::vector<Buffer> to_buffers();
+
+    // Removes every frame from this batch
+    void clear();
+
+    // Calls `visit` with every frame packed into `body`, the body of a MULTI_MESSAGE_BATCH frame
+    static void unpack(const Buffer &body, std::function<void(const char *frame, size_t size)> visit);
+
+  private:
+    // The most bytes that the serialized batch may take up
+    size_t capacity_;
+
+    // The number of bytes that the serialized batch takes up
+    size_t size_;
+
+    // Holds the header and entry count of the serialized batch, whose header has no optional fields
+    unsigned char head_[MulticastMessageHeader::BASE_SIZE + sizeof(uint32_t)];
+
+    // The number of frames in this batch
+    uint32_t count_;
+
+    // The size prefix of every frame added by `add`, which never move once added
+    std::deque<uint32_t> prefixes_;
+
+    // Views of the prefixes and frames of every entry, in order
+    std::vector<Buffer> parts_;
+};
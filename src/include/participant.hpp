@@ -8,15 +8,26 @@
 #include <unordered_map>
 #include <thread>
 #include <atomic>
+#include <memory>
+#include <mutex>
 
+#include "async_logger.hpp"
+#include "coordinator_session.hpp"
+#include "metrics.hpp"
 #include "multicast_message.hpp"
 #include "inet/internet_socket.hpp"
 
 class Participant {
     public:
         // Constructs a client identified by `pid` that logs all received multicast messages in 
-        // `log_file` after connecting to the coordinator at address `remoteaddr` on port `remote_port`
-        Participant(int pid, std::string log_file, std::string remoteaddr, uint16_t remote_port);
+        // `log_file` after connecting to the coordinator at address `remoteaddr` on port `remote_port`,
+        // writing the log as described by `logger_options` and keeping up to `msend_window` msends
+        // in flight. Its metrics are written to `stats_path` once every `stats_interval`, unless
+        // `stats_path` is empty
+        Participant(int pid, std::string log_file, std::string remoteaddr, uint16_t remote_port,
+            LoggerOptions logger_options = LoggerOptions(),
+            size_t msend_window = CoordinatorSession::DEFAULT_WINDOW,
+            std::string stats_path = "", std::chrono::seconds stats_interval = DEFAULT_STATS_INTERVAL);
 
         // Establishes connection with the coordinator and begins multicast process
         void start();
@@ -51,9 +62,25 @@ class Participant {
         // Handle Quit Command
         void handleQuit();
 
+        // Handle Stats Command
+        void handleStats(MulticastMessage participant_request);
+
+        // Handle Subscribe Command
+        void handleSubscribe(MulticastMessage participant_request);
+
+        // Handle Unsubscribe Command
+        void handleUnsubscribe(MulticastMessage participant_request);
+
         // Handle all messages that are sent by other participants
         void handleIncomingMulticastMessages();
 
+        // Queues a multicast message that was received from the coordinator to be printed and logged
+        void logMulticastMessage(MulticastMessageHeader header, std::string data);
+
+        // Discards the chunks gathered so far of every message sent to `group` (0 for messages sent
+        // to everyone)
+        void discardPartialMessages(uint32_t group);
+
         // Socket to be used by this participant to receive messages
         InternetSocket participant_receive_socket_;
 
@@ -66,12 +93,22 @@ class Participant {
         // path of log_file
         std::string log_file_path_;
 
+        // Prints and appends received multicast messages to the log file in the background, so
+        // that the thread receiving them never waits on the filesystem
+        AsyncLogger message_logger_;
+
         // Coordinator address that will be connected to
         std::string remoteaddr;
 
         // Coordinator port that will be connected to
         int coordinator_port;
 
+        // The one connection that every request is sent to the coordinator over
+        CoordinatorSession coordinator_session_;
+
+        // Writes this participant's metrics to a file in the background, if it was given one
+        std::unique_ptr<StatsWriter> stats_writer_;
+
         // Is the participant registered
         std::atomic<bool> registered_ = false;
 
@@ -81,6 +118,53 @@ class Participant {
         // Is the participant running
         std::atomic<bool> is_running_;
 
+        // The version of the wire format agreed on with the coordinator when registering
+        uint8_t protocol_version_ = PROTOCOL_VERSION;
+
+        // The smallest msend body that is compressed before being sent, or 0 if the coordinator did
+        // not enable compression
+        size_t compression_threshold_ = 0;
+
+        // The largest msend body that fits in one frame, above which msends are split into chunks,
+        // or 0 if the coordinator did not say
+        size_t chunk_size_ = 0;
+
+        // The largest frame accepted from the coordinator, which is the larger of the largest frame
+        // it accepts and the largest batch of messages it sends
+        size_t max_receive_size_ = DEFAULT_MAX_FRAME_SIZE;
+
+        // The chunks received so far of every message whose last chunk has not arrived yet
+        // Key: id of the message's named group (or 0) shifted above the pid of the sender
+        // Val: the message so far
+        std::unordered_map<uint64_t, std::string> partial_messages_;
+
+        // Guards `partial_messages_`, which unsubscribing from a group frees part of
+        //
+        // Note: Must be taken after `subscriptions_lock_` when both are held
+        std::mutex partial_messages_lock_;
+
+        // The sequence number of the last multicast message received, which is sent when
+        // reconnecting so that the coordinator resumes right after it
+        std::atomic<uint64_t> last_sequence_ = 0;
+
+        // Represents a named group this participant subscribes to
+        struct Subscription {
+            // The name of the group
+            std::string name;
+
+            // The sequence number of the last message of the group received, which is sent when
+            // reconnecting just like `last_sequence_`
+            uint64_t last_sequence = 0;
+        };
+
+        // Every named group this participant subscribes to
+        // Key: group id
+        // Val: subscription
+        std::unordered_map<uint32_t, Subscription> subscriptions_;
+
+        // Guards `subscriptions_`, which the thread receiving messages reads
+        std::mutex subscriptions_lock_;
+
         // Maps string to Command, to be used in `parse_input`
         const std::unordered_map<std::string, MulticastMessageType> cmd_map_ = {
             {"register", MulticastMessageType::PARTICIPANT_REGISTER}, 
@@ -88,6 +172,10 @@ class Participant {
             {"disconnect", MulticastMessageType::PARTICIPANT_DISCONNECT},
             {"reconnect" ,MulticastMessageType::PARTICIPANT_RECONNECT}, 
             {"msend", MulticastMessageType::PARTICIPANT_MSEND},
-            {"quit", MulticastMessageType::PARTICIPANT_QUIT}
+            {"gsend", MulticastMessageType::PARTICIPANT_MSEND},
+            {"subscribe", MulticastMessageType::PARTICIPANT_SUBSCRIBE},
+            {"unsubscribe", MulticastMessageType::PARTICIPANT_UNSUBSCRIBE},
+            {"quit", MulticastMessageType::PARTICIPANT_QUIT},
+            {"stats", MulticastMessageType::PARTICIPANT_STATS}
         };
 };
\ No newline at end of file
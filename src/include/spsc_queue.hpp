@@ -0,0 +1,95 @@
+// File: include/spsc_queue.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// A bounded, lock-free queue with exactly one producing thread and exactly one consuming thread
+//
+// The slots form a ring whose size is a power of two. The producer only writes `tail_` and the
+// consumer only writes `head_`, and each side keeps a cached copy of the other side's index so it
+// only has to read the shared one when the queue looks full (or empty).
+template <typename T>
+class SpscQueue {
+  public:
+    // Constructs an empty queue that holds at least `capacity` values
+    explicit SpscQueue(size_t capacity) :
+        slots_(round_up_(capacity)),
+        mask_(slots_.size() - 1),
+        head_(0),
+        tail_(0),
+        cached_head_(0),
+        cached_tail_(0) {}
+
+    // Makes this queue non-copyable and non-copy-assignable
+    SpscQueue(SpscQueue &other) = delete;
+    SpscQueue &operator=(SpscQueue &other) = delete;
+
+    // Moves `value` to the back of the queue, returning false instead if the queue is full
+    //
+    // Note: Must only be called from the producing thread
+    bool try_push(T &&value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == slots_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size()) return false;
+        }
+
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Moves the value at the front of the queue into `value`, returning false instead if the queue
+    // is empty
+    //
+    // Note: Must only be called from the consuming thread
+    bool try_pop(T &value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) return false;
+        }
+
+        value = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Returns true if the queue holds no values (which may change as soon as this returns)
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+  private:
+    // Returns the smallest power of two that is at least `capacity`
+    static size_t round_up_(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        return size;
+    }
+
+    // The slots of the ring
+    std::vector<T> slots_;
+
+    // Masks a position into an index of `slots_`
+    size_t mask_;
+
+    // The position of the next value to pop (written by the consumer)
+    alignas(64) std::atomic<size_t> head_;
+
+    // The position of the next value to push (written by the producer)
+    alignas(64) std::atomic<size_t> tail_;
+
+    // The producer's copy of `head_`
+    alignas(64) size_t cached_head_;
+
+    // The consumer's copy of `tail_`
+    alignas(64) size_t cached_tail_;
+};
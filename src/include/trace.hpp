@@ -0,0 +1,163 @@
+// File: include/trace.hpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#pragma once
+
+// Trace spans are only recorded in builds made with `make TRACE=1`, which defines MULTICAST_TRACE.
+// In every other build `TRACE_SPAN` expands to nothing and none of the code below is compiled.
+#ifdef MULTICAST_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "metrics.hpp"
+
+// Represents one span that was recorded by a thread
+struct TraceEvent {
+    // What the span timed, which is always a string literal
+    const char *name = nullptr;
+
+    // When the span started, in nanoseconds on the steady clock
+    uint64_t start_ns = 0;
+
+    // How long the span lasted, in nanoseconds
+    uint64_t duration_ns = 0;
+
+    // The number of the thread that recorded the span
+    uint32_t thread_id = 0;
+};
+
+// Holds the most recent spans recorded by one thread
+//
+// A buffer is handed to another thread once its owner exits, and keeps the spans of its earlier
+// owners until the new one overwrites them. Only the thread that owns the buffer ever writes to it, so recording takes no lock: the oldest
+// span is overwritten once the buffer is full. Every slot carries a sequence number that is odd
+// while the slot is being written, which lets a reader on another thread tell when a span it copied
+// was overwritten halfway and leave it out.
+class TraceBuffer {
+  public:
+    // The number of spans each thread keeps
+    static const size_t CAPACITY = 16 * 1024;
+
+    // Constructs an empty buffer for the thread numbered `thread_id`
+    explicit TraceBuffer(uint32_t thread_id);
+
+    // Makes this buffer non-copyable and non-copy-assignable
+    TraceBuffer(TraceBuffer &other) = delete;
+    TraceBuffer &operator=(TraceBuffer &other) = delete;
+
+    // Records a span called `name` that lasted from `start_ns` to `end_ns`
+    //
+    // Note: Must only be called by the thread that owns this buffer
+    void record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+        uint64_t index = head_.load(std::memory_order_relaxed);
+        Slot &slot     = slots_[index % CAPACITY];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start_ns.store(start_ns, std::memory_order_relaxed);
+        slot.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+        slot.thread_id.store(thread_id_, std::memory_order_relaxed);
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+        head_.store(index + 1, std::memory_order_release);
+    }
+
+    // Hands this buffer to the thread numbered `thread_id`, which records its spans after those of
+    // the thread that owned it before
+    //
+    // Note: Must only be called by the thread that takes the buffer over
+    void adopt(uint32_t thread_id) { thread_id_ = thread_id; }
+
+    // Appends every span still held by this buffer to `events`, oldest first
+    void collect(std::vector<TraceEvent> &events) const;
+
+    // Returns the number of spans recorded so far, including those already overwritten
+    uint64_t recorded() const { return head_.load(std::memory_order_acquire); }
+
+  private:
+    // One recorded span, along with the sequence number that guards it
+    struct Slot {
+        std::atomic<uint64_t> sequence {0};
+        std::atomic<const char *> name {nullptr};
+        std::atomic<uint64_t> start_ns {0};
+        std::atomic<uint64_t> duration_ns {0};
+        std::atomic<uint32_t> thread_id {0};
+    };
+
+    // The number of the thread that owns this buffer, which only the owner reads
+    uint32_t thread_id_;
+
+    // The number of spans recorded so far, the last `CAPACITY` of which are held in `slots_`
+    std::atomic<uint64_t> head_;
+
+    // The spans, each in the slot its number leaves as the remainder when divided by `CAPACITY`
+    std::unique_ptr<Slot[]> slots_;
+};
+
+// Returns the current time on the steady clock, in nanoseconds
+inline uint64_t trace_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Returns the buffer that the calling thread records its spans in, taking over the buffer of a
+// thread that exited or creating one on first use
+TraceBuffer &trace_buffer();
+
+// Returns every span held by the buffer of every thread that has recorded one, as a Chrome
+// trace-event JSON document that can be opened in chrome://tracing or Perfetto
+std::string trace_json();
+
+// Returns the number of spans recorded so far by every thread
+uint64_t trace_recorded();
+
+// Records the span between its construction and destruction in the calling thread's buffer
+class TraceSpan {
+  public:
+    // Starts a span called `name`, which must be a string literal
+    explicit TraceSpan(const char *name) : name_(name), started_(trace_now()) {}
+
+    // Ends the span
+    ~TraceSpan() { trace_buffer().record(name_, started_, trace_now()); }
+
+    // Makes this span non-copyable and non-copy-assignable
+    TraceSpan(TraceSpan &other) = delete;
+    TraceSpan &operator=(TraceSpan &other) = delete;
+
+  private:
+    // What the span times
+    const char *name_;
+
+    // When the span started
+    uint64_t started_;
+};
+
+// How often a `TraceWriter` exports the spans recorded so far
+static const std::chrono::seconds DEFAULT_TRACE_INTERVAL(5);
+
+// Exports the spans of every thread to a file from a background thread, once every `interval`
+// that new spans were recorded in, replacing the export it wrote before
+class TraceWriter : public PeriodicFileWriter {
+  public:
+    // Starts exporting spans to `path`
+    TraceWriter(std::string path, std::chrono::milliseconds interval);
+};
+
+#define TRACE_CONCAT_(first, second) first##second
+#define TRACE_CONCAT(first, second) TRACE_CONCAT_(first, second)
+
+// Records a span called `name` from this point to the end of the enclosing scope
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#else
+
+#define TRACE_SPAN(name) static_cast<void>(0)
+
+#endif
@@ -2,15 +2,28 @@
 // Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
 
 #include "include/inet/internet_socket.hpp"
+#include "include/metrics.hpp"
+#include "include/trace.hpp"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <limits.h>
 #include <netdb.h>
 #include <sys/poll.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
 
+// Every byte that any socket of the process sent or received
+static Counter &socket_bytes_sent     = metrics().counter("socket.bytes_sent");
+static Counter &socket_bytes_received = metrics().counter("socket.bytes_received");
+
 // Utility Functions -------------------------------------------------------------------------------
 
 void perror_and_exit(const char *header) {
@@ -27,6 +40,7 @@ InternetAddress::InternetAddress(const sockaddr_in &ipv4_addr, socklen_t ipv4_ad
     size_(ipv4_addr_size) {}
 
 InternetAddress InternetAddress::from_ip_address(const char *name, const char *port) {
+    TRACE_SPAN("socket.resolve");
     // Use getaddrinfo() to get information using the inputted arguments
     addrinfo hints, *socket_info;
     std::memset(&hints, 0, sizeof(hints));
@@ -76,11 +90,16 @@ InternetSocket &InternetSocket::operator=(InternetSocket &other) {
     return *this;
 }
 
-InternetSocket::InternetSocket(InternetSocket &&other) { *this = std::move(other); }
+InternetSocket::InternetSocket(InternetSocket &&other) : file_desc_(-1) {
+    *this = std::move(other);
+}
 
 InternetSocket &InternetSocket::operator=(InternetSocket &&other) {
     if (this == &other) return *this;
 
+    // Release the socket that this one previously held
+    do_close_();
+
     // Move values from the other socket to this one
     this->file_desc_   = other.file_desc_;
     this->host_addr_   = other.host_addr_;
@@ -108,9 +127,17 @@ void InternetSocket::do_bind(uint16_t host_port) {
 void InternetSocket::do_connect(std::string remote_addr, uint16_t remote_port) {
     std::string port = std::to_string((int)remote_port);
 
-    remote_addr_ = InternetAddress::from_ip_address(remote_addr.c_str(), port.c_str());
+    if (!try_connect(InternetAddress::from_ip_address(remote_addr.c_str(), port.c_str()))) {
+        perror_and_exit("connect() failed");
+    }
+}
+
+bool InternetSocket::try_connect(InternetAddress remote_addr) {
+    TRACE_SPAN("socket.connect");
+    remote_addr_ = remote_addr;
     int result   = connect(file_desc_, (sockaddr *)remote_addr_.ptr(), remote_addr_.size());
-    if (result < 0) perror_and_exit("connect() failed");
+
+    return result == 0;
 }
 
 void InternetSocket::do_listen(size_t backlog_size) {
@@ -119,6 +146,7 @@ void InternetSocket::do_listen(size_t backlog_size) {
 }
 
 InternetSocket InternetSocket::do_accept() {
+    TRACE_SPAN("socket.accept");
     sockaddr_in sa_in;
     socklen_t sa_in_size = sizeof(sa_in);
 
@@ -128,10 +156,62 @@ InternetSocket InternetSocket::do_accept() {
     return InternetSocket(remote_fd, host_addr_, InternetAddress(sa_in, sa_in_size));
 }
 
-size_t InternetSocket::do_send(const Buffer &buffer, int flags) {
+InternetSocket InternetSocket::try_accept(bool *exhausted) {
+    TRACE_SPAN("socket.accept");
+    sockaddr_in sa_in;
+    socklen_t sa_in_size = sizeof(sa_in);
+
+    // A connection that was reset while it waited is skipped in favor of the next one
+    int remote_fd = -1;
+    do {
+        sa_in_size = sizeof(sa_in);
+        remote_fd  = accept4(file_desc_, (sockaddr *)&sa_in, &sa_in_size, SOCK_NONBLOCK);
+    } while (remote_fd < 0 && (errno == ECONNABORTED || errno == EPROTO || errno == EINTR));
+
+    if (remote_fd < 0 && (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)) {
+        if (exhausted != nullptr) *exhausted = true;
+    } else if (remote_fd < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror_and_exit("accept4() failed");
+    }
+
+    return InternetSocket(remote_fd, host_addr_, InternetAddress(sa_in, sa_in_size));
+}
+
+void InternetSocket::do_set_nonblocking() {
+    int flags = fcntl(file_desc_, F_GETFL, 0);
+    if (flags < 0) perror_and_exit("fcntl() failed");
+
+    int result = fcntl(file_desc_, F_SETFL, flags | O_NONBLOCK);
+    if (result < 0) perror_and_exit("fcntl() failed");
+}
+
+void InternetSocket::do_set_reuseport() {
+    int optval = 1;
+    int result = setsockopt(file_desc_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+    if (result < 0) perror_and_exit("setsockopt() failed");
+}
+
+void InternetSocket::do_set_nodelay() {
+    int optval = 1;
+    int result = setsockopt(file_desc_, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    if (result < 0) perror_and_exit("setsockopt() failed");
+}
+
+void InternetSocket::do_set_send_timeout(std::chrono::milliseconds timeout) {
+    timeval optval;
+    optval.tv_sec  = timeout.count() / 1000;
+    optval.tv_usec = (timeout.count() % 1000) * 1000;
+    int result = setsockopt(file_desc_, SOL_SOCKET, SO_SNDTIMEO, &optval, sizeof(optval));
+    if (result < 0) perror_and_exit("setsockopt() failed");
+}
+
+bool InternetSocket::is_valid() const { return file_desc_ > 0; }
 
+size_t InternetSocket::do_send(const Buffer &buffer, int flags) {
+    TRACE_SPAN("socket.send");
     int bytes_sent = send(file_desc_, buffer.data(), buffer.size(), flags);
     if (bytes_sent < 0) perror_and_exit("send() failed");
+    socket_bytes_sent.add(bytes_sent);
 
     return bytes_sent;
 }
@@ -150,10 +230,112 @@ void InternetSocket::do_sendall(const Buffer &buffer, int flags) {
     }
 }
 
-size_t InternetSocket::do_recv(Buffer &buffer, int flags) {
+bool InternetSocket::try_sendall(const Buffer &buffer) {
+    TRACE_SPAN("socket.send");
+    size_t total_sent = 0;
+
+    while (total_sent < buffer.size()) {
+        ssize_t bytes_sent = send(file_desc_, (char *)buffer.data() + total_sent,
+                                  buffer.size() - total_sent, MSG_NOSIGNAL);
+        if (bytes_sent < 0 && errno == EINTR) continue;
+        if (bytes_sent < 0) return false;
+        total_sent += bytes_sent;
+        socket_bytes_sent.add(bytes_sent);
+    }
+
+    return true;
+}
+
+void InternetSocket::do_sendv(const std::vector<Buffer> &data) {
+    if (!try_sendv(data)) perror_and_exit("sendmsg() failed");
+}
+
+bool InternetSocket::try_sendv(const std::vector<Buffer> &data) {
+    TRACE_SPAN("socket.sendv");
+    std::vector<iovec> parts;
+    parts.reserve(data.size());
+    for (const Buffer &buffer : data) {
+        if (buffer.size() > 0) parts.push_back(iovec {buffer.data(), buffer.size()});
+    }
+
+    size_t first = 0;
+    while (first < parts.size()) {
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov    = &parts[first];
+        message.msg_iovlen = std::min<size_t>(parts.size() - first, IOV_MAX);
+
+        ssize_t bytes_sent = sendmsg(file_desc_, &message, MSG_NOSIGNAL);
+        if (bytes_sent < 0 && errno == EINTR) continue;
+        if (bytes_sent < 0) return false;
+        socket_bytes_sent.add(bytes_sent);
+
+        // Skip every part that was sent in full, then trim the part that was only partially sent
+        size_t remaining = bytes_sent;
+        while (first < parts.size() && remaining >= parts[first].iov_len) {
+            remaining -= parts[first].iov_len;
+            first++;
+        }
+        if (remaining > 0) {
+            parts[first].iov_base = (char *)parts[first].iov_base + remaining;
+            parts[first].iov_len -= remaining;
+        }
+    }
 
+    return true;
+}
+
+TransferInfo InternetSocket::try_send(const Buffer &buffer) {
+    TRACE_SPAN("socket.send");
+    TransferInfo result = {0, false, false};
+
+    while (result.bytes < buffer.size()) {
+        ssize_t bytes_sent = send(file_desc_, (char *)buffer.data() + result.bytes,
+                                  buffer.size() - result.bytes, MSG_NOSIGNAL);
+        if (bytes_sent < 0 && errno == EINTR) continue;
+        if (bytes_sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            result.would_block = true;
+            break;
+        }
+        if (bytes_sent < 0) {
+            result.closed = true;
+            break;
+        }
+        result.bytes += bytes_sent;
+    }
+    socket_bytes_sent.add(result.bytes);
+
+    return result;
+}
+
+TransferInfo InternetSocket::try_recv(Buffer &buffer) {
+    TRACE_SPAN("socket.recv");
+    TransferInfo result = {0, false, false};
+
+    while (result.bytes < buffer.size()) {
+        ssize_t bytes_recvd =
+            recv(file_desc_, (char *)buffer.data() + result.bytes, buffer.size() - result.bytes, 0);
+        if (bytes_recvd < 0 && errno == EINTR) continue;
+        if (bytes_recvd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            result.would_block = true;
+            break;
+        }
+        if (bytes_recvd <= 0) {
+            result.closed = true;
+            break;
+        }
+        result.bytes += bytes_recvd;
+    }
+    socket_bytes_received.add(result.bytes);
+
+    return result;
+}
+
+size_t InternetSocket::do_recv(Buffer &buffer, int flags) {
+    TRACE_SPAN("socket.recv");
     int bytes_recvd = recv(file_desc_, buffer.data(), buffer.size(), flags);
     if (bytes_recvd < 0) perror_and_exit("recv() failed");
+    socket_bytes_received.add(bytes_recvd);
 
     return bytes_recvd;
 }
@@ -233,7 +415,7 @@ PollInfo InternetSocket::do_poll(PollInfo request, size_t timeout) {
 
 InternetSocket::InternetSocket(int file_desc, InternetAddress host_addr,
                                InternetAddress remote_addr) :
-    file_desc_(dup(file_desc)),
+    file_desc_(file_desc),
     host_addr_(host_addr),
     remote_addr_(remote_addr) {}
 
@@ -253,4 +435,5 @@ void InternetSocket::do_open_() {
 void InternetSocket::do_close_() {
     // Close the file descriptor
     if (file_desc_ > 0) close(file_desc_);
+    file_desc_ = -1;
 }
\ No newline at end of file
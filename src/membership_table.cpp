@@ -0,0 +1,85 @@
+// File: membership_table.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/membership_table.hpp"
+
+// MembershipTable Public API Functions ------------------------------------------------------------
+
+MembershipTable::MembershipTable(size_t stride) :
+    stride_(stride),
+    states_((PID_COUNT + stride - 1) / stride, MemberState::UNREGISTERED),
+    ips_(states_.size()),
+    ports_(states_.size(), 0),
+    disconnect_times_(states_.size(), 0),
+    sequences_(states_.size(), 0),
+    connected_slots_(states_.size(), 0),
+    disconnected_count_(0) {}
+
+void MembershipTable::add(uint16_t pid, std::string ip, uint16_t port) {
+    remove(pid);
+
+    states_[slot_(pid)] = MemberState::CONNECTED;
+    ips_[slot_(pid)]    = ip;
+    ports_[slot_(pid)]  = port;
+    link_(pid);
+}
+
+void MembershipTable::remove(uint16_t pid) {
+    if (states_[slot_(pid)] == MemberState::CONNECTED) unlink_(pid);
+    if (states_[slot_(pid)] == MemberState::DISCONNECTED) disconnected_count_--;
+
+    states_[slot_(pid)] = MemberState::UNREGISTERED;
+    ips_[slot_(pid)].clear();
+}
+
+void MembershipTable::connect(uint16_t pid, uint16_t port) {
+    if (states_[slot_(pid)] != MemberState::DISCONNECTED) return;
+
+    states_[slot_(pid)] = MemberState::CONNECTED;
+    ports_[slot_(pid)]  = port;
+    disconnected_count_--;
+    link_(pid);
+}
+
+void MembershipTable::disconnect(uint16_t pid, time_t disconnect_time, uint64_t sequence) {
+    if (states_[slot_(pid)] != MemberState::CONNECTED) return;
+
+    states_[slot_(pid)]           = MemberState::DISCONNECTED;
+    disconnect_times_[slot_(pid)] = disconnect_time;
+    sequences_[slot_(pid)]        = sequence;
+    disconnected_count_++;
+    unlink_(pid);
+}
+
+MemberState MembershipTable::state(uint16_t pid) const { return states_[slot_(pid)]; }
+
+const std::string &MembershipTable::ip(uint16_t pid) const { return ips_[slot_(pid)]; }
+
+uint16_t MembershipTable::port(uint16_t pid) const { return ports_[slot_(pid)]; }
+
+time_t MembershipTable::disconnect_time(uint16_t pid) const { return disconnect_times_[slot_(pid)]; }
+
+uint64_t MembershipTable::sequence(uint16_t pid) const { return sequences_[slot_(pid)]; }
+
+size_t MembershipTable::disconnected_count() const { return disconnected_count_; }
+
+const std::vector<uint16_t> &MembershipTable::connected() const { return connected_list_; }
+
+// MembershipTable Private API Functions -----------------------------------------------------------
+
+size_t MembershipTable::slot_(uint16_t pid) const { return pid / stride_; }
+
+void MembershipTable::link_(uint16_t pid) {
+    connected_slots_[slot_(pid)] = connected_list_.size();
+    connected_list_.push_back(pid);
+}
+
+void MembershipTable::unlink_(uint16_t pid) {
+    // Move the last pid into the hole, so the list stays compact
+    uint32_t slot = connected_slots_[slot_(pid)];
+    uint16_t last = connected_list_.back();
+
+    connected_list_[slot]  = last;
+    connected_slots_[slot_(last)] = slot;
+    connected_list_.pop_back();
+}
@@ -0,0 +1,347 @@
+// File: message_log.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/message_log.hpp"
+#include "include/multicast_message.hpp"
+#include "include/trace.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+void perror_and_exit(const char *header);
+
+// MessageLog Public API Functions -----------------------------------------------------------------
+
+MessageLog::MessageLog(std::string directory, size_t segment_size) :
+    directory_(directory),
+    segment_size_(segment_size),
+    active_fd_(-1) {
+    std::filesystem::create_directories(directory_);
+    recover_();
+
+    roll_();
+}
+
+MessageLog::~MessageLog() {
+    if (active_fd_ >= 0) close(active_fd_);
+}
+
+bool MessageLog::append(const Buffer &frame, time_t arrived_at, uint64_t sequence) {
+    TRACE_SPAN("message_log.append");
+    std::lock_guard<std::mutex> lock(lock_);
+
+    // Nobody whose window has closed needs this record, so it is never written if they are all
+    // that is left
+    expire_(arrived_at);
+    bool needed = false;
+    for (auto &[pid, cursor] : cursors_) needed = needed || cursor.to == OPEN;
+    if (!needed) return false;
+
+    uint64_t record_size = FRAME_PREFIX_SIZE + frame.size();
+    Segment &active      = segments_.rbegin()->second;
+    if (active.size > 0 && active.size + record_size > segment_size_) roll_();
+
+    unsigned char prefix[FRAME_PREFIX_SIZE];
+    encode_frame_prefix(prefix, frame.size());
+
+    // Write the size and the frame with a single call
+    iovec record[2];
+    record[0].iov_base = prefix;
+    record[0].iov_len  = FRAME_PREFIX_SIZE;
+    record[1].iov_base = frame.data();
+    record[1].iov_len  = frame.size();
+
+    ssize_t bytes_written = writev(active_fd_, record, 2);
+    if (bytes_written != (ssize_t)record_size) perror_and_exit("writev() failed");
+
+    index_.push_back(IndexEntry {sequence, end_(), arrived_at});
+    segments_.rbegin()->second.size += record_size;
+
+    return true;
+}
+
+uint64_t MessageLog::end_offset() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return end_();
+}
+
+uint64_t MessageLog::seek(uint64_t sequence) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    // Records are appended in sequence order, so the index is sorted by sequence number
+    auto entry = std::upper_bound(index_.begin(), index_.end(), sequence,
+                                  [](uint64_t sequence, const IndexEntry &entry) {
+                                      return sequence < entry.sequence;
+                                  });
+
+    return entry == index_.end() ? end_() : entry->offset;
+}
+
+uint64_t MessageLog::open_cursor(uint16_t pid, time_t expires_at) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    uint64_t offset = end_();
+    cursors_[pid]   = Cursor {offset, OPEN, expires_at};
+
+    return offset;
+}
+
+void MessageLog::restore_cursor(uint16_t pid, uint64_t from, time_t expires_at) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    // Records past the end of the log were lost along with their segments
+    from = std::min(from, end_());
+
+    // The window may have closed before the last records were appended, in which case the cursor
+    // ends at the first record that arrived after it closed
+    auto first = std::lower_bound(index_.begin(), index_.end(), from,
+                                  [](const IndexEntry &entry, uint64_t offset) {
+                                      return entry.offset < offset;
+                                  });
+    auto closed = std::find_if(first, index_.end(), [expires_at](const IndexEntry &entry) {
+        return entry.arrived_at > expires_at;
+    });
+
+    cursors_[pid] = Cursor {from, closed == index_.end() ? OPEN : closed->offset, expires_at};
+}
+
+bool MessageLog::find_cursor(uint16_t pid, Cursor &cursor) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    auto entry = cursors_.find(pid);
+    if (entry == cursors_.end()) return false;
+    cursor = entry->second;
+
+    return true;
+}
+
+uint64_t MessageLog::cursor_end(uint16_t pid) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    auto cursor = cursors_.find(pid);
+    if (cursor == cursors_.end() || cursor->second.to == OPEN) return end_();
+
+    return cursor->second.to;
+}
+
+std::map<uint16_t, uint64_t> MessageLog::backlogs() {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    std::map<uint16_t, uint64_t> result;
+    uint64_t end = end_();
+    for (auto &cursor : cursors_) {
+        uint64_t to = cursor.second.to == OPEN ? end : cursor.second.to;
+        result[cursor.first] = to > cursor.second.from ? to - cursor.second.from : 0;
+    }
+
+    return result;
+}
+
+void MessageLog::close_cursor(uint16_t pid) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    cursors_.erase(pid);
+    collect_();
+}
+
+uint64_t MessageLog::retain(uint64_t from, uint64_t to) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    uint64_t token = next_hold_token_++;
+    holds_[token]  = Hold {from, to};
+
+    return token;
+}
+
+void MessageLog::release(uint64_t token) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    holds_.erase(token);
+    collect_();
+}
+
+uint64_t MessageLog::compact(time_t now) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    expire_(now);
+    return collect_();
+}
+
+uint64_t MessageLog::reclaimed_bytes() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return reclaimed_bytes_;
+}
+
+void MessageLog::read(uint64_t from, uint64_t to,
+                      std::function<void(const char *frame, size_t size)> visit,
+                      std::function<void()> unmapping) {
+    // Take note of the segments to read, so that appends can continue while they are being walked
+    std::vector<std::pair<uint64_t, Segment>> to_read;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        // Start at the segment that holds `from`, since records never span segments
+        auto segment = segments_.upper_bound(from);
+        if (segment != segments_.begin()) segment--;
+        for (; segment != segments_.end() && segment->first < to; segment++) {
+            to_read.push_back(*segment);
+        }
+    }
+
+    static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+    for (auto &[base_offset, segment] : to_read) {
+        uint64_t begin = std::max(from, base_offset) - base_offset;
+        uint64_t end   = std::min(to, base_offset + segment.size) - base_offset;
+        if (begin >= end) continue;
+
+        // Mappings must start on a page boundary
+        uint64_t map_offset = begin - (begin % page_size);
+        size_t map_size     = end - map_offset;
+
+        int fd = ::open(segment.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) perror_and_exit("open() failed");
+        void *mapping = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+        close(fd);
+        if (mapping == MAP_FAILED) perror_and_exit("mmap() failed");
+        madvise(mapping, map_size, MADV_SEQUENTIAL);
+
+        const unsigned char *records = (const unsigned char *)mapping;
+        size_t position              = begin - map_offset;
+        while (position + FRAME_PREFIX_SIZE <= map_size) {
+            uint32_t frame_size = decode_frame_prefix(&records[position]);
+            position += FRAME_PREFIX_SIZE;
+            visit((const char *)&records[position], frame_size);
+            position += frame_size;
+        }
+
+        if (unmapping) unmapping();
+        munmap(mapping, map_size);
+    }
+}
+
+// MessageLog Private API Functions ----------------------------------------------------------------
+
+uint64_t MessageLog::end_() { return segments_.rbegin()->first + segments_.rbegin()->second.size; }
+
+void MessageLog::expire_(time_t now) {
+    uint64_t end = end_();
+    for (auto &[pid, cursor] : cursors_) {
+        if (cursor.to == OPEN && cursor.expires_at < now) cursor.to = end;
+    }
+}
+
+void MessageLog::recover_() {
+    for (const auto &entry : std::filesystem::directory_iterator(directory_)) {
+        if (entry.path().extension() != ".log") continue;
+        uint64_t base_offset = std::strtoull(entry.path().stem().c_str(), nullptr, 10);
+        segments_[base_offset] = Segment {entry.path().string(), entry.file_size()};
+    }
+
+    for (auto &[base_offset, segment] : segments_) {
+        if (segment.size == 0) continue;
+
+        int fd = ::open(segment.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) perror_and_exit("open() failed");
+        void *mapping = mmap(nullptr, segment.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) perror_and_exit("mmap() failed");
+        madvise(mapping, segment.size, MADV_SEQUENTIAL);
+
+        const unsigned char *records = (const unsigned char *)mapping;
+        uint64_t position            = 0;
+        while (position + FRAME_PREFIX_SIZE <= segment.size) {
+            uint32_t frame_size = decode_frame_prefix(&records[position]);
+            if (position + FRAME_PREFIX_SIZE + frame_size > segment.size) break;
+
+            MulticastMessageHeader header;
+            size_t header_size = MulticastMessageHeader::decode(
+                &records[position + FRAME_PREFIX_SIZE], frame_size, header);
+            if (header_size == 0) break;
+
+            index_.push_back(
+                IndexEntry {header.sequence, base_offset + position, header.coordinator_time});
+            position += FRAME_PREFIX_SIZE + frame_size;
+        }
+        munmap(mapping, segment.size);
+
+        if (position < segment.size) {
+            if (truncate(segment.path.c_str(), position) < 0) perror_and_exit("truncate() failed");
+            segment.size = position;
+        }
+    }
+}
+
+void MessageLog::roll_() {
+    uint64_t base_offset = 0;
+    if (!segments_.empty()) base_offset = end_();
+
+    if (active_fd_ >= 0) close(active_fd_);
+
+    std::string path = segment_path_(base_offset);
+    active_fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (active_fd_ < 0) perror_and_exit("open() failed");
+
+    segments_[base_offset] = Segment {path, 0};
+}
+
+uint64_t MessageLog::collect_() {
+    // Every range of records that something still refers to
+    std::vector<Hold> needed;
+    for (auto &[pid, cursor] : cursors_) {
+        if (cursor.from < cursor.to) needed.push_back(Hold {cursor.from, cursor.to});
+    }
+    for (auto &[token, hold] : holds_) {
+        if (hold.from < hold.to) needed.push_back(hold);
+    }
+
+    // When nobody needs even the active segment anymore, start a fresh one so it can be deleted too
+    bool active_needed = false;
+    for (Hold &range : needed) active_needed = active_needed || range.to > segments_.rbegin()->first;
+    if (!active_needed && segments_.rbegin()->second.size > 0) roll_();
+
+    // Segments are deleted wherever nothing refers to them, which may leave gaps in the log, but
+    // the active segment is always kept
+    uint64_t reclaimed = 0;
+    for (auto segment = segments_.begin(); std::next(segment) != segments_.end();) {
+        uint64_t segment_end = segment->first + segment->second.size;
+
+        bool segment_needed = false;
+        for (Hold &range : needed) {
+            segment_needed =
+                segment_needed || (range.from < segment_end && range.to > segment->first);
+        }
+        if (segment_needed) {
+            segment++;
+            continue;
+        }
+
+        std::filesystem::remove(segment->second.path);
+        reclaimed += segment->second.size;
+        segment = segments_.erase(segment);
+    }
+
+    // Records in gaps left by deleted segments are never sought, since nothing refers to them, so
+    // only the front of the index has to be trimmed
+    while (!index_.empty() && index_.front().offset < segments_.begin()->first) index_.pop_front();
+
+    reclaimed_bytes_ += reclaimed;
+    return reclaimed;
+}
+
+std::string MessageLog::segment_path_(uint64_t base_offset) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu.log", (unsigned long long)base_offset);
+
+    return directory_ + "/" + name;
+}
@@ -0,0 +1,165 @@
+// File: metrics.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+void perror_and_exit(const char *header);
+
+// Counter Public API Functions --------------------------------------------------------------------
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const Slot &slot : slots_) total += slot.value.load(std::memory_order_relaxed);
+
+    return total;
+}
+
+// HistogramSnapshot Public API Functions ----------------------------------------------------------
+
+double HistogramSnapshot::mean() const { return count > 0 ? (double)sum / count : 0; }
+
+uint64_t HistogramSnapshot::percentile(double fraction) const {
+    if (count == 0) return 0;
+
+    // The rank of the value that `fraction` of the values are at or below, counting from 1
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(fraction * count));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); bucket++) {
+        seen += buckets[bucket];
+        if (seen >= rank) return Histogram::bucket_limit(bucket);
+    }
+
+    return Histogram::bucket_limit(buckets.size() - 1);
+}
+
+// Histogram Public API Functions ------------------------------------------------------------------
+
+// The slots are value-initialized, which zeroes every bucket
+Histogram::Histogram() : slots_(new Slot[METRIC_SLOTS]()) {}
+
+HistogramSnapshot Histogram::snapshot() const {
+    HistogramSnapshot result;
+    result.buckets.assign(BUCKET_COUNT, 0);
+
+    // Buckets are read while other threads keep recording, so a snapshot may be a few values
+    // behind, but its count always matches its buckets
+    for (size_t index = 0; index < METRIC_SLOTS; index++) {
+        const Slot &slot = slots_[index];
+        result.sum += slot.sum.load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+            uint64_t count = slot.buckets[bucket].load(std::memory_order_relaxed);
+            result.buckets[bucket] += count;
+            result.count += count;
+        }
+    }
+
+    return result;
+}
+
+uint64_t Histogram::bucket_limit(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    size_t shift   = (bucket >> SUB_BUCKET_BITS) - 1;
+    uint64_t lower = (uint64_t)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+
+    return lower + (((uint64_t)1 << shift) - 1);
+}
+
+// MetricsRegistry Public API Functions ------------------------------------------------------------
+
+Counter &MetricsRegistry::counter(const std::string &name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    std::unique_ptr<Counter> &entry = counters_[name];
+    if (!entry) entry = std::make_unique<Counter>();
+
+    return *entry;
+}
+
+Histogram &MetricsRegistry::histogram(const std::string &name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    std::unique_ptr<Histogram> &entry = histograms_[name];
+    if (!entry) entry = std::make_unique<Histogram>();
+
+    return *entry;
+}
+
+std::string MetricsRegistry::report() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    std::ostringstream out;
+
+    for (const auto &entry : counters_) out << entry.first << " " << entry.second->value() << "\n";
+    for (const auto &entry : histograms_) {
+        HistogramSnapshot snapshot = entry.second->snapshot();
+        out << entry.first << " count=" << snapshot.count
+            << " mean=" << (uint64_t)snapshot.mean()
+            << " p50=" << snapshot.percentile(0.5)
+            << " p90=" << snapshot.percentile(0.9)
+            << " p99=" << snapshot.percentile(0.99)
+            << " p999=" << snapshot.percentile(0.999)
+            << " max=" << snapshot.percentile(1) << "\n";
+    }
+
+    return out.str();
+}
+
+MetricsRegistry &metrics() {
+    // Never destroyed, so metrics may still be recorded by threads that outlive `main`
+    static MetricsRegistry *registry = new MetricsRegistry();
+    return *registry;
+}
+
+// PeriodicFileWriter Public API Functions ---------------------------------------------------------
+
+PeriodicFileWriter::PeriodicFileWriter(std::string path, std::chrono::milliseconds interval,
+                                       Contents contents) :
+    path_(path),
+    interval_(interval),
+    contents_(std::move(contents)),
+    stopping_(false) {
+    worker_ = std::thread(&PeriodicFileWriter::run_, this);
+}
+
+PeriodicFileWriter::~PeriodicFileWriter() {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_one();
+    worker_.join();
+}
+
+// PeriodicFileWriter Private API Functions --------------------------------------------------------
+
+void PeriodicFileWriter::run_() {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!stopping_) {
+        stop_cv_.wait_for(lock, interval_, [this] { return stopping_; });
+        write_();
+    }
+}
+
+void PeriodicFileWriter::write_() {
+    std::optional<std::string> contents = contents_();
+    if (!contents) return;
+
+    std::string temporary = path_ + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        if (!out.is_open()) perror_and_exit("open() failed");
+        out << *contents;
+    }
+    if (std::rename(temporary.c_str(), path_.c_str()) < 0) perror_and_exit("rename() failed");
+}
+
+// StatsWriter Public API Functions ----------------------------------------------------------------
+
+StatsWriter::StatsWriter(std::string path, std::chrono::milliseconds interval,
+                         std::function<std::string()> extra) :
+    PeriodicFileWriter(path, interval, [extra]() -> std::optional<std::string> {
+        return extra ? metrics().report() + extra() : metrics().report();
+    }) {}
@@ -2,22 +2,134 @@
 // Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
 
 #include "include/multicast_message.hpp"
+#include "include/compression.hpp"
 
+#include <algorithm>
 #include <cstring>
-
-#include <sstream>
+#include <ctime>
+#include <ostream>
 #include <unordered_map>
 
+void encode_frame_prefix(unsigned char *prefix, uint32_t frame_size) {
+    for (size_t i = 0; i < FRAME_PREFIX_SIZE; i++) prefix[i] = (frame_size >> (8 * i)) & 0xFF;
+}
+
+uint32_t decode_frame_prefix(const unsigned char *prefix) {
+    uint32_t frame_size = 0;
+    for (size_t i = 0; i < FRAME_PREFIX_SIZE; i++) frame_size |= (uint32_t)prefix[i] << (8 * i);
+    return frame_size;
+}
+
+// Writes the `width` lowest bytes of `value` to `data`, least significant first
+static inline void store_le(unsigned char *data, uint64_t value, size_t width) {
+    for (size_t i = 0; i < width; i++) data[i] = (value >> (8 * i)) & 0xFF;
+}
+
+// Returns the `width` bytes at `data` read as a little-endian integer
+static inline uint64_t load_le(const unsigned char *data, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; i++) value |= (uint64_t)data[i] << (8 * i);
+    return value;
+}
+
+// Returns the number of bytes taken up by a header with `flags`
+static inline size_t header_size(uint8_t flags) {
+    size_t size = MulticastMessageHeader::BASE_SIZE;
+    if (flags & HEADER_FLAG_SEQUENCE) size += sizeof(uint64_t);
+    if (flags & HEADER_FLAG_TIME) size += sizeof(uint32_t);
+    if (flags & HEADER_FLAG_REQUEST_ID) size += sizeof(uint32_t);
+    if (flags & HEADER_FLAG_GROUP) size += sizeof(uint32_t);
+    return size;
+}
+
+size_t MulticastMessageHeader::encoded_size() const { return header_size(flags); }
+
+size_t MulticastMessageHeader::encode(unsigned char *data) const {
+    data[0] = version;
+    data[1] = (uint8_t)type;
+    data[2] = flags;
+    store_le(data + 3, pid, sizeof(uint16_t));
+    store_le(data + 5, size, sizeof(uint32_t));
+
+    size_t position = BASE_SIZE;
+    if (flags & HEADER_FLAG_SEQUENCE) {
+        store_le(data + position, sequence, sizeof(uint64_t));
+        position += sizeof(uint64_t);
+    }
+    if (flags & HEADER_FLAG_TIME) {
+        store_le(data + position, (uint32_t)coordinator_time, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+    }
+    if (flags & HEADER_FLAG_REQUEST_ID) {
+        store_le(data + position, request_id, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+    }
+    if (flags & HEADER_FLAG_GROUP) {
+        store_le(data + position, group, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+    }
+
+    return position;
+}
+
+size_t MulticastMessageHeader::peek_size(const unsigned char *data, size_t available) {
+    if (available < BASE_SIZE) return 0;
+    return header_size(data[2]);
+}
+
+size_t MulticastMessageHeader::decode(const unsigned char *data, size_t available,
+                                      MulticastMessageHeader &header) {
+    size_t encoded_size = peek_size(data, available);
+    if (encoded_size == 0 || available < encoded_size) return 0;
+
+    header.version  = data[0];
+    header.type     = (MulticastMessageType)data[1];
+    header.flags    = data[2];
+    header.pid      = load_le(data + 3, sizeof(uint16_t));
+    header.size     = load_le(data + 5, sizeof(uint32_t));
+    header.sequence = 0;
+    header.coordinator_time = 0;
+    header.request_id = 0;
+    header.group = 0;
+
+    size_t position = BASE_SIZE;
+    if (header.flags & HEADER_FLAG_SEQUENCE) {
+        header.sequence = load_le(data + position, sizeof(uint64_t));
+        position += sizeof(uint64_t);
+    }
+    if (header.flags & HEADER_FLAG_TIME) {
+        header.coordinator_time = load_le(data + position, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+    }
+    if (header.flags & HEADER_FLAG_REQUEST_ID) {
+        header.request_id = load_le(data + position, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+    }
+    if (header.flags & HEADER_FLAG_GROUP) {
+        header.group = load_le(data + position, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+    }
+
+    return position;
+}
+
 MulticastMessageHeader MulticastMessageHeader::from_buffer(Buffer &buffer) {
     MulticastMessageHeader result;
 
-    std::memcpy(&result, buffer.data(), sizeof(result));
+    decode((const unsigned char *)buffer.data(), buffer.size(), result);
 
     return result;
 }
 
-std::ostream &operator<<(std::ostream &stream, const MulticastMessageHeader &header) {
-    std::unordered_map<MulticastMessageType, std::string> type_map = {
+uint32_t group_id(const std::string &name) {
+    // FNV-1a, with 0 left for messages that are addressed to every participant
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : name) hash = (hash ^ c) * 16777619u;
+    return hash != 0 ? hash : 1;
+}
+
+std::string type_name(MulticastMessageType type) {
+    static const std::unordered_map<MulticastMessageType, std::string> type_map = {
         {MulticastMessageType::INVALID, "INVALID"},
         {MulticastMessageType::NEGATIVE_ACKNOWLEDGEMENT, "NACK"},
         {MulticastMessageType::ACKNOWLEDGEMENT, "ACK"},
@@ -27,18 +139,25 @@ std::ostream &operator<<(std::ostream &stream, const MulticastMessageHeader &hea
         {MulticastMessageType::PARTICIPANT_RECONNECT, "RECONNECT"},
         {MulticastMessageType::PARTICIPANT_MSEND, "MSEND"},
         {MulticastMessageType::PARTICIPANT_QUIT, "QUIT"},
-        {MulticastMessageType::MULTI_MESSAGE, "MULTICAST MESSAGE"}
+        {MulticastMessageType::MULTI_MESSAGE, "MULTICAST MESSAGE"},
+        {MulticastMessageType::MULTI_MESSAGE_BATCH, "MULTICAST MESSAGE BATCH"},
+        {MulticastMessageType::PARTICIPANT_EVICTED, "EVICTED"},
+        {MulticastMessageType::PARTICIPANT_STATS, "STATS"},
+        {MulticastMessageType::PARTICIPANT_SUBSCRIBE, "SUBSCRIBE"},
+        {MulticastMessageType::PARTICIPANT_UNSUBSCRIBE, "UNSUBSCRIBE"}
     };
 
-    std::stringstream ss;
-
-    ss << "MulticastMessage(";
-    ss << "type=" << type_map[header.type];
-    ss << ", pid=" << header.pid;
-    ss << ", size=" << header.size;
-    ss << ")";
+    auto name = type_map.find(type);
+    return name != type_map.end() ? name->second : "";
+}
 
-    stream << ss.str();
+std::ostream &operator<<(std::ostream &stream, const MulticastMessageHeader &header) {
+    // Written straight to the stream, since this is called for every request the coordinator logs
+    stream << "MulticastMessage(";
+    stream << "type=" << type_name(header.type);
+    stream << ", pid=" << header.pid;
+    stream << ", size=" << header.size;
+    stream << ")";
 
     return stream;
 }
@@ -48,25 +167,215 @@ MulticastMessage::MulticastMessage(MulticastMessageType type, uint16_t pid, time
     header_.pid = pid;
     header_.size = 0;
     header_.coordinator_time = time_sent;
+    if (type == MulticastMessageType::MULTI_MESSAGE) header_.flags |= HEADER_FLAG_TIME;
 }
 
 MulticastMessageHeader MulticastMessage::header() { return header_; }
 
-std::string MulticastMessage::body() { return body_; }
+const std::string &MulticastMessage::body() { return body_; }
+
+std::string MulticastMessage::take_body() {
+    std::string body = std::move(body_);
+    body_.clear();
+    header_.size = 0;
+
+    return body;
+}
+
+void MulticastMessage::set_version(uint8_t version) { header_.version = version; }
+
+void MulticastMessage::set_sequence(uint64_t sequence) {
+    header_.sequence = sequence;
+    header_.flags |= HEADER_FLAG_SEQUENCE;
+}
+
+void MulticastMessage::set_request_id(uint32_t request_id) {
+    header_.request_id = request_id;
+    header_.flags |= HEADER_FLAG_REQUEST_ID;
+}
+
+void MulticastMessage::set_group(uint32_t group) {
+    header_.group = group;
+    header_.flags |= HEADER_FLAG_GROUP;
+}
+
+void MulticastMessage::set_chunk_flags(uint8_t chunk_flags) {
+    header_.flags |= chunk_flags & (HEADER_FLAG_MORE_CHUNKS | HEADER_FLAG_CONTINUATION);
+}
+
+std::vector<MulticastMessage> MulticastMessage::split(size_t chunk_size) {
+    if (chunk_size == 0 || body_.size() <= chunk_size) return {*this};
+
+    std::vector<MulticastMessage> chunks;
+    for (size_t offset = 0; offset < body_.size(); offset += chunk_size) {
+        MulticastMessage chunk = *this;
+        chunk.body_ = body_.substr(offset, chunk_size);
+        chunk.header_.size = chunk.body_.size();
+
+        uint8_t chunk_flags = 0;
+        if (offset > 0) chunk_flags |= HEADER_FLAG_CONTINUATION;
+        if (offset + chunk_size < body_.size()) chunk_flags |= HEADER_FLAG_MORE_CHUNKS;
+        chunk.set_chunk_flags(chunk_flags);
+
+        chunks.push_back(std::move(chunk));
+    }
+
+    return chunks;
+}
+
+void MulticastMessage::set_compressed() { header_.flags |= HEADER_FLAG_COMPRESSED; }
+
+bool MulticastMessage::compress(size_t threshold) {
+    if ((header_.flags & HEADER_FLAG_COMPRESSED) || body_.size() < threshold) return false;
+
+    std::string compressed = compress_payload(body_.data(), body_.size());
+    if (compressed.size() >= body_.size()) return false;
+
+    body_ = std::move(compressed);
+    header_.size = body_.size();
+    header_.flags |= HEADER_FLAG_COMPRESSED;
+
+    return true;
+}
+
+bool MulticastMessage::decompress() {
+    if (!(header_.flags & HEADER_FLAG_COMPRESSED)) return true;
+
+    std::string decompressed;
+    if (!decompress_payload(body_.data(), body_.size(), decompressed)) return false;
+
+    body_ = std::move(decompressed);
+    header_.size = body_.size();
+    header_.flags &= ~HEADER_FLAG_COMPRESSED;
+
+    return true;
+}
 
 MulticastMessage &operator<<(MulticastMessage &message, std::string data) {
-    message.body_ += data;
+    if (message.body_.empty()) {
+        message.body_ = std::move(data);
+    } else {
+        message.body_ += data;
+    }
     message.header_.size = message.body_.size();
 
     return message;
 }
 
 Buffer MulticastMessage::to_buffer() {
-    Buffer result(sizeof(MulticastMessageHeader) + body_.size());
+    Buffer result(header_.encoded_size() + body_.size());
 
-    std::memcpy(result.data(), &header_, sizeof(header_));
+    size_t header_size = header_.encode((unsigned char *)result.data());
 
-    std::memcpy((char *)result.data() + sizeof(header_), body_.data(), body_.size());
+    std::memcpy((char *)result.data() + header_size, body_.data(), body_.size());
 
     return result;
-}
\ No newline at end of file
+}
+
+std::vector<Buffer> MulticastMessage::to_buffers() {
+    size_t header_size = header_.encode(encoded_header_);
+
+    std::vector<Buffer> result;
+    result.reserve(2);
+    result.push_back(Buffer(encoded_header_, header_size));
+    result.push_back(Buffer(body_.data(), body_.size()));
+
+    return result;
+}
+
+void MulticastMessage::append_to(std::string &out) {
+    size_t header_size = header_.encode(encoded_header_);
+
+    out.append((char *)encoded_header_, header_size);
+    out.append(body_);
+}
+
+Buffer MulticastMessage::to_shared_buffer() {
+    Buffer result = Buffer::make_shared(header_.encoded_size() + body_.size());
+
+    size_t header_size = header_.encode((unsigned char *)result.data());
+
+    std::memcpy((char *)result.data() + header_size, body_.data(), body_.size());
+
+    return result;
+}
+
+MulticastBatch::MulticastBatch(size_t capacity) :
+    capacity_(std::max(capacity, sizeof(head_))),
+    size_(sizeof(head_)),
+    count_(0) {}
+
+bool MulticastBatch::fits(size_t frame_size) const {
+    return size_ + FRAME_PREFIX_SIZE + frame_size <= capacity_;
+}
+
+void MulticastBatch::add(const void *frame, size_t frame_size) {
+    unsigned char prefix[FRAME_PREFIX_SIZE];
+    encode_frame_prefix(prefix, frame_size);
+
+    prefixes_.push_back(0);
+    std::memcpy(&prefixes_.back(), prefix, FRAME_PREFIX_SIZE);
+    parts_.push_back(Buffer(&prefixes_.back(), FRAME_PREFIX_SIZE));
+    parts_.push_back(Buffer((void *)frame, frame_size));
+
+    size_ += FRAME_PREFIX_SIZE + frame_size;
+    count_++;
+}
+
+void MulticastBatch::add_entry(const void *entry, size_t entry_size) {
+    bool follows_last = !parts_.empty()
+                        && (const char *)parts_.back().data() + parts_.back().size() == entry;
+    if (follows_last) {
+        parts_.back() = Buffer(parts_.back().data(), parts_.back().size() + entry_size);
+    } else {
+        parts_.push_back(Buffer((void *)entry, entry_size));
+    }
+
+    size_ += entry_size;
+    count_++;
+}
+
+size_t MulticastBatch::count() const { return count_; }
+
+std::vector<Buffer> MulticastBatch::to_buffers() {
+    MulticastMessageHeader header;
+    header.type = MulticastMessageType::MULTI_MESSAGE_BATCH;
+    header.size = size_ - MulticastMessageHeader::BASE_SIZE;
+    header.encode(head_);
+
+    // The count is little-endian, just like every prefix
+    encode_frame_prefix(head_ + MulticastMessageHeader::BASE_SIZE, count_);
+
+    std::vector<Buffer> result;
+    result.reserve(1 + parts_.size());
+    result.push_back(Buffer(head_, sizeof(head_)));
+    for (const Buffer &part : parts_) result.push_back(Buffer(part.data(), part.size()));
+
+    return result;
+}
+
+void MulticastBatch::clear() {
+    size_ = sizeof(head_);
+    count_ = 0;
+    prefixes_.clear();
+    parts_.clear();
+}
+
+void MulticastBatch::unpack(const Buffer &body,
+                            std::function<void(const char *frame, size_t size)> visit) {
+    if (body.size() < FRAME_PREFIX_SIZE) return;
+
+    const unsigned char *entries = (const unsigned char *)body.data();
+    uint32_t count               = decode_frame_prefix(entries);
+    size_t position              = FRAME_PREFIX_SIZE;
+
+    // Stop at the first entry that does not fit in the body rather than reading past it
+    for (uint32_t i = 0; i < count && position + FRAME_PREFIX_SIZE <= body.size(); i++) {
+        uint32_t frame_size = decode_frame_prefix(entries + position);
+        position += FRAME_PREFIX_SIZE;
+        if (frame_size < MulticastMessageHeader::BASE_SIZE || position + frame_size > body.size()) return;
+
+        visit((const char *)entries + position, frame_size);
+        position += frame_size;
+    }
+}
@@ -0,0 +1,55 @@
+// File: mybench.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "include/benchmark.hpp"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <benchmark_config_file>\n";
+        return EXIT_FAILURE;
+    }
+
+    // read from file
+    std::vector<std::string> benchmark_args;
+    std::string file_name = argv[1];
+    std::ifstream infile(file_name);
+    std::string line;
+    if (!infile.is_open()) {
+        std::cout << "Could not open the file - " << file_name << "\n";
+        return EXIT_FAILURE;
+    }
+    while(std::getline(infile, line)) {
+        benchmark_args.push_back(line);
+    }
+
+    BenchmarkOptions options;
+    options.coordinator_port = stoi(benchmark_args.at(0));
+    options.participants = stoi(benchmark_args.at(1));
+    options.msends_per_second = stoi(benchmark_args.at(2));
+    options.message_size = stoi(benchmark_args.at(3));
+    options.duration_seconds = stoi(benchmark_args.at(4));
+    // The churn rate is optional
+    if (benchmark_args.size() > 5 && !benchmark_args.at(5).empty()) {
+        options.disconnects_per_second = stod(benchmark_args.at(5));
+    }
+    // So is the number of coordinator shards
+    if (benchmark_args.size() > 6 && !benchmark_args.at(6).empty()) {
+        options.coordinator_shards = stoi(benchmark_args.at(6));
+    }
+    // So is the compression threshold
+    if (benchmark_args.size() > 7 && !benchmark_args.at(7).empty()) {
+        options.compression_threshold = stoi(benchmark_args.at(7));
+    }
+
+    // The coordinator under test is the one built next to this executable
+    std::string bench_path = argv[0];
+    size_t slash = bench_path.rfind('/');
+    options.coordinator_path = (slash == std::string::npos ? std::string(".") : bench_path.substr(0, slash)) + "/mycoordinator";
+
+    Benchmark benchmark(options);
+    return benchmark.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -26,7 +26,63 @@ int main (int argc, char** argv) {
     while(std::getline(infile, line)) {
         coordinator_args.push_back(line);
     }
-    Coordinator coordinator(stoi(coordinator_args.at(0)), stoi(coordinator_args.at(1)));
+    // The delivery settings are optional
+    DeliveryOptions delivery_options;
+    if (coordinator_args.size() > 2 && !coordinator_args.at(2).empty()) {
+        delivery_options.workers = stoi(coordinator_args.at(2));
+    }
+    if (coordinator_args.size() > 3 && !coordinator_args.at(3).empty()) {
+        delivery_options.batch_max_bytes = stoi(coordinator_args.at(3));
+    }
+    if (coordinator_args.size() > 4 && !coordinator_args.at(4).empty()) {
+        delivery_options.batch_linger = std::chrono::microseconds(stoi(coordinator_args.at(4)));
+    }
+    if (coordinator_args.size() > 8 && !coordinator_args.at(8).empty()) {
+        delivery_options.mailbox_max_messages = stoi(coordinator_args.at(8));
+    }
+    if (coordinator_args.size() > 9 && !coordinator_args.at(9).empty()) {
+        delivery_options.mailbox_max_bytes = stoi(coordinator_args.at(9));
+    }
+    if (coordinator_args.size() > 10 && !coordinator_args.at(10).empty()) {
+        std::string policy = coordinator_args.at(10);
+        if (policy == "drop") delivery_options.overflow_policy = OverflowPolicy::DROP_OLDEST;
+        else if (policy == "disconnect") delivery_options.overflow_policy = OverflowPolicy::DISCONNECT;
+        else delivery_options.overflow_policy = OverflowPolicy::SPILL;
+    }
+    if (coordinator_args.size() > 13 && !coordinator_args.at(13).empty()) {
+        delivery_options.send_timeout = std::chrono::milliseconds(stoi(coordinator_args.at(13)));
+    }
+    // So is the number of shards, which has to leave at least one shard to serve participants
+    size_t shard_count = 1;
+    if (coordinator_args.size() > 5 && !coordinator_args.at(5).empty()) {
+        std::string shards = coordinator_args.at(5);
+        if (shards.find_first_not_of("0123456789") != std::string::npos || shards.size() > 3
+            || stoi(shards) < 1 || stoi(shards) > (int)Coordinator::MAX_SHARD_COUNT) {
+            std::cerr << "Usage: line 6 of " << file_name << " must be a number of shards from 1 to " << Coordinator::MAX_SHARD_COUNT << "\n";
+            return EXIT_FAILURE;
+        }
+        shard_count = stoi(shards);
+    }
+    // So is the compression threshold
+    size_t compression_threshold = 0;
+    if (coordinator_args.size() > 6 && !coordinator_args.at(6).empty()) {
+        compression_threshold = stoi(coordinator_args.at(6));
+    }
+    // So is the largest frame
+    size_t max_frame_size = DEFAULT_MAX_FRAME_SIZE;
+    if (coordinator_args.size() > 7 && !coordinator_args.at(7).empty()) {
+        max_frame_size = stoi(coordinator_args.at(7));
+    }
+    // So is the file that metrics are written to, and how often
+    std::string stats_path;
+    if (coordinator_args.size() > 11) {
+        stats_path = coordinator_args.at(11);
+    }
+    std::chrono::seconds stats_interval = DEFAULT_STATS_INTERVAL;
+    if (coordinator_args.size() > 12 && !coordinator_args.at(12).empty()) {
+        stats_interval = std::chrono::seconds(stoi(coordinator_args.at(12)));
+    }
+    Coordinator coordinator(stoi(coordinator_args.at(0)), stoi(coordinator_args.at(1)), delivery_options, shard_count, compression_threshold, max_frame_size, stats_path, stats_interval);
     coordinator.start();
     return EXIT_SUCCESS;
 }
\ No newline at end of file
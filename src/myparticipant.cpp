@@ -34,7 +34,38 @@ int main(int argc, char** argv) {
     std::string remoteaddr = participant_args.at(2).substr(0, participant_args.at(2).find(" "));
     int remote_port = stoi(participant_args.at(2).substr(participant_args.at(2).find(" ") + 1));
 
-    Participant participant(std::stoi(participant_args.at(0)), participant_args.at(1), remoteaddr, remote_port);
+    // The log settings are optional
+    LoggerOptions logger_options;
+    if (participant_args.size() > 3 && !participant_args.at(3).empty()) {
+        std::string sync = participant_args.at(3);
+        if (sync == "none") logger_options.sync = LogSync::NONE;
+        else if (sync == "write") logger_options.sync = LogSync::EVERY_WRITE;
+        else {
+            logger_options.sync = LogSync::PERIODIC;
+            logger_options.sync_interval = std::chrono::milliseconds(stoi(sync));
+        }
+    }
+    if (participant_args.size() > 4 && !participant_args.at(4).empty()) {
+        logger_options.flush_interval = std::chrono::milliseconds(stoi(participant_args.at(4)));
+    }
+
+    // So is the number of msends that may be in flight at once
+    size_t msend_window = CoordinatorSession::DEFAULT_WINDOW;
+    if (participant_args.size() > 5 && !participant_args.at(5).empty()) {
+        msend_window = stoi(participant_args.at(5));
+    }
+
+    // So is the file that metrics are written to, and how often
+    std::string stats_path;
+    if (participant_args.size() > 6) {
+        stats_path = participant_args.at(6);
+    }
+    std::chrono::seconds stats_interval = DEFAULT_STATS_INTERVAL;
+    if (participant_args.size() > 7 && !participant_args.at(7).empty()) {
+        stats_interval = std::chrono::seconds(stoi(participant_args.at(7)));
+    }
+
+    Participant participant(std::stoi(participant_args.at(0)), participant_args.at(1), remoteaddr, remote_port, logger_options, msend_window, stats_path, stats_interval);
     participant.start();
     return EXIT_SUCCESS;
 }
\ No newline at end of file
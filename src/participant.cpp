@@ -2,18 +2,34 @@
 // Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
 
 #include "include/participant.hpp"
+#include "include/compression.hpp"
+#include "include/coordinator_session.hpp"
+#include "include/frame_reader.hpp"
 #include "include/multicast_message.hpp"
+#include "include/trace.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <sstream>
 #include <fstream>
 #include <ctime>
 
+// The multicast messages this participant received, counting each chunk of a chunked message
+static Counter &messages_received = metrics().counter("participant.messages_received");
+static Counter &message_bytes_received = metrics().counter("participant.message_bytes_received");
+
 Participant::Participant(int pid, std::string log_file, 
-    std::string remoteaddr, uint16_t remote_port) : 
-    pid_(pid), log_file_path_(log_file),
-    remoteaddr(remoteaddr), coordinator_port(remote_port) 
-{ }
+    std::string remoteaddr, uint16_t remote_port, LoggerOptions logger_options, size_t msend_window,
+    std::string stats_path, std::chrono::seconds stats_interval) : 
+    pid_(pid), log_file_path_(log_file), message_logger_(log_file, logger_options),
+    remoteaddr(remoteaddr), coordinator_port(remote_port),
+    coordinator_session_(remoteaddr, remote_port, msend_window)
+{
+    if (!stats_path.empty()) {
+        this->stats_writer_ = std::make_unique<StatsWriter>(stats_path, stats_interval);
+    }
+}
 
 void Participant::start() {
     this->is_running_ = true;
@@ -23,8 +39,16 @@ void Participant::start() {
     std::cout << "reconnect [portnumber]" << "\n";
     std::cout << "disconnect" << "\n";
     std::cout << "msend [message]" << "\n";
+    std::cout << "subscribe [group]" << "\n";
+    std::cout << "unsubscribe [group]" << "\n";
+    std::cout << "gsend [group] [message]" << "\n";
     std::cout << "quit" << "\n";
+    std::cout << "stats" << "\n";
     std::cout << "You can begin typing in your commands below, there is no prompt due to issues involving using std::cout and std::cin at the same time" << "\n";
+#ifdef MULTICAST_TRACE
+    // The last export is written once the participant quits
+    TraceWriter trace_writer("participant_" + std::to_string(this->pid_) + "_trace.json", DEFAULT_TRACE_INTERVAL);
+#endif
     while (is_running_) {
         MulticastMessage participant_request = MulticastMessage(MulticastMessageType::INVALID, this->pid_, std::time(0));
         try {
@@ -61,9 +85,18 @@ MulticastMessage Participant::parse_input(std::string participant_input) {
     // TODO: Implement Multicast Message Constructor
     MulticastMessage participant_req(req_type, this->pid_, std::time(0));
 
+    // A group send names its group first, and everything after that is the message
+    if (input_vector[0] == "gsend") {
+        if (input_vector.size() < 3 || input_vector[1].empty()) throw std::out_of_range("gsend needs a group and a message");
+        participant_req.set_group(group_id(input_vector[1]));
+        participant_req << participant_input.substr(input_vector[0].size() + input_vector[1].size() + 2);
+        return participant_req;
+    }
+
+    // Everything after the command is its argument, so messages may contain spaces
     if (input_vector.size() > 1) {
         std::string req_data;
-        req_data = input_vector[1];
+        req_data = participant_input.substr(participant_input.find(' ') + 1);
         participant_req << req_data;
     }
 
@@ -71,6 +104,11 @@ MulticastMessage Participant::parse_input(std::string participant_input) {
 }
 
 void Participant::handle_request(MulticastMessage participant_request) {
+    // Registering offers the newest version this participant speaks, every request after it uses
+    // the version that the coordinator agreed to (deliveries always come with PROTOCOL_VERSION)
+    if (participant_request.header().type != MulticastMessageType::PARTICIPANT_REGISTER) {
+        participant_request.set_version(this->protocol_version_);
+    }
     switch (participant_request.header().type) {
         case MulticastMessageType::PARTICIPANT_REGISTER: {
             this->handleRegister(participant_request);
@@ -96,6 +134,18 @@ void Participant::handle_request(MulticastMessage participant_request) {
             this->handleQuit();
             break;
         };
+        case MulticastMessageType::PARTICIPANT_STATS: {
+            this->handleStats(participant_request);
+            break;
+        };
+        case MulticastMessageType::PARTICIPANT_SUBSCRIBE: {
+            this->handleSubscribe(participant_request);
+            break;
+        };
+        case MulticastMessageType::PARTICIPANT_UNSUBSCRIBE: {
+            this->handleUnsubscribe(participant_request);
+            break;
+        };
         default: {
             break;
         };
@@ -107,29 +157,54 @@ void Participant::handleRegister(MulticastMessage participant_request) {
         std::cout << "> You are already registered" << "\n";
         return;
     }
-    InternetSocket participant_send_socket_;
-    participant_send_socket_.do_connect(this->remoteaddr, this->coordinator_port);
-    participant_send_socket_.do_sendall(participant_request.to_buffer());
-    Buffer header_buffer(sizeof(MulticastMessageHeader));
-    size_t bytes_recvd = participant_send_socket_.do_recv(header_buffer, MSG_PEEK);
-
-    if (bytes_recvd == 0) {
+    // A participant that the coordinator disconnected may still have its receiving thread winding down
+    if (incoming_messages_thread_.joinable()) {
+        incoming_messages_thread_.join();
+    }
+    // Listen before registering, since the coordinator connects to this port as soon as it accepts
+    this->participant_receive_socket_ = InternetSocket();
+    this->participant_receive_socket_.do_bind(stoi(participant_request.body()));
+    this->participant_receive_socket_.do_listen(10);
+    // Offer to read compressed bodies, which the coordinator may ask every participant to send
+    participant_request.set_compressed();
+    Reply reply = this->coordinator_session_.request(participant_request);
+    MulticastMessageHeader header = reply.header;
+    if (header.type == MulticastMessageType::ACKNOWLEDGEMENT && (header.version < MIN_PROTOCOL_VERSION || header.version > PROTOCOL_VERSION)) {
+        std::cout << "> The coordinator answered with unsupported protocol version " << (int)header.version << "\n";
+        this->participant_receive_socket_ = InternetSocket();
         return;
     }
-    participant_send_socket_.do_recvall(header_buffer);
-    MulticastMessageHeader header = MulticastMessageHeader::from_buffer(header_buffer);
     if (header.type == MulticastMessageType::ACKNOWLEDGEMENT) {
         std::cout << "> You are now registered and connected to the multicast group" << "\n";
+        this->protocol_version_ = header.version;
+        // The acknowledgement carries the compression threshold, the largest frame the coordinator
+        // accepts and the largest batch of messages it sends
+        std::istringstream settings(reply.body);
+        size_t compression_threshold = 0;
+        size_t max_frame_size = 0;
+        size_t max_batch_size = 0;
+        settings >> compression_threshold >> max_frame_size >> max_batch_size;
+        this->compression_threshold_ = (header.flags & HEADER_FLAG_COMPRESSED) ? compression_threshold : 0;
+        this->chunk_size_ = max_frame_size > MulticastMessageHeader::MAX_SIZE ? max_frame_size - MulticastMessageHeader::MAX_SIZE : 0;
+        // Coordinators that do not say how large their frames are use the default limit
+        this->max_receive_size_ = std::max(max_frame_size > 0 ? max_frame_size : DEFAULT_MAX_FRAME_SIZE, max_batch_size);
         this->registered_ = true;
         this->connected_ = true;
-        this->participant_receive_socket_.do_bind(stoi(participant_request.body()));
-        this->participant_receive_socket_.do_listen(10);
+        this->last_sequence_ = 0;
+        // The coordinator drops every subscription of a participant that registers, and numbers its
+        // messages afresh, so nothing gathered before is ever completed
+        {
+            std::lock_guard<std::mutex> lock(this->subscriptions_lock_);
+            this->subscriptions_.clear();
+            std::lock_guard<std::mutex> partial_lock(this->partial_messages_lock_);
+            this->partial_messages_.clear();
+        }
         incoming_messages_thread_ = std::thread(&Participant::handleIncomingMulticastMessages, this);
-        incoming_messages_thread_.detach();
         return;
     }
     else {
         std::cout << "> You were not able to register to the multicast group" << "\n";
+        this->participant_receive_socket_ = InternetSocket();
         return;
     }
 }
@@ -144,17 +219,8 @@ void Participant::handleDeregister(MulticastMessage participant_request) {
         std::cout << "> Please disconnect before deregistering" << "\n";
         return;
     }
-    InternetSocket participant_send_socket_;
-    participant_send_socket_.do_connect(this->remoteaddr, this->coordinator_port);
-    participant_send_socket_.do_sendall(participant_request.to_buffer());
-    Buffer header_buffer(sizeof(MulticastMessageHeader));
-    size_t bytes_recvd = participant_send_socket_.do_recv(header_buffer, MSG_PEEK);
-
-    if (bytes_recvd == 0) {
-        return;
-    }
-    participant_send_socket_.do_recvall(header_buffer);
-    MulticastMessageHeader header = MulticastMessageHeader::from_buffer(header_buffer);
+    Reply reply = this->coordinator_session_.request(participant_request);
+    MulticastMessageHeader header = reply.header;
     if (header.type == MulticastMessageType::ACKNOWLEDGEMENT) {
         std::cout << "> You are now deregistered from the multicast group" << "\n";
         this->registered_ = false;
@@ -175,29 +241,32 @@ void Participant::handleReconnect(MulticastMessage participant_request) {
         std::cout << "> You are already connected" << "\n";
         return;
     }
-    InternetSocket participant_send_socket_;
-    participant_send_socket_.do_connect(this->remoteaddr, this->coordinator_port);
-    participant_send_socket_.do_sendall(participant_request.to_buffer());
-    Buffer header_buffer(sizeof(MulticastMessageHeader));
-    size_t bytes_recvd = participant_send_socket_.do_recv(header_buffer, MSG_PEEK);
-
-    if (bytes_recvd == 0) {
-        return;
+    // A participant that the coordinator disconnected may still have its receiving thread winding down
+    if (incoming_messages_thread_.joinable()) {
+        incoming_messages_thread_.join();
+    }
+    // Listen before reconnecting, since the coordinator connects to this port to replay missed messages
+    this->participant_receive_socket_ = InternetSocket();
+    this->participant_receive_socket_.do_bind(stoi(participant_request.body()));
+    this->participant_receive_socket_.do_listen(10);
+    participant_request << " " + std::to_string(this->last_sequence_);
+    {
+        std::lock_guard<std::mutex> lock(this->subscriptions_lock_);
+        for (auto &[group, subscription] : this->subscriptions_) {
+            participant_request << " " + std::to_string(group) + ":" + std::to_string(subscription.last_sequence);
+        }
     }
-    participant_send_socket_.do_recvall(header_buffer);
-    MulticastMessageHeader header = MulticastMessageHeader::from_buffer(header_buffer);
+    Reply reply = this->coordinator_session_.request(participant_request);
+    MulticastMessageHeader header = reply.header;
     if (header.type == MulticastMessageType::ACKNOWLEDGEMENT) {
         this->connected_ = true;
-        this->participant_receive_socket_ = InternetSocket();
-        this->participant_receive_socket_.do_bind(stoi(participant_request.body()));
-        this->participant_receive_socket_.do_listen(10);
         incoming_messages_thread_ = std::thread(&Participant::handleIncomingMulticastMessages, this);
-        incoming_messages_thread_.detach();
         std::cout << "> You are now reconnected to the multicast group, will begin by sending missed messages" << "\n";
         return;
     }
     else {
         std::cout << "> You were not able to reconnect to the multicast group" << "\n";
+        this->participant_receive_socket_ = InternetSocket();
         return;
     }
 }
@@ -211,25 +280,17 @@ void Participant::handleDisconnect(MulticastMessage participant_request) {
         std::cout << "> You are already disconnected" << "\n";
         return;
     }
-    InternetSocket participant_send_socket_;
-    participant_send_socket_.do_connect(this->remoteaddr, this->coordinator_port);
-    participant_send_socket_.do_sendall(participant_request.to_buffer());
-    Buffer header_buffer(sizeof(MulticastMessageHeader));
-    size_t bytes_recvd = participant_send_socket_.do_recv(header_buffer, MSG_PEEK);
-
-    if (bytes_recvd == 0) {
-        return;
-    }
-    participant_send_socket_.do_recvall(header_buffer);
-    MulticastMessageHeader header = MulticastMessageHeader::from_buffer(header_buffer);
+    Reply reply = this->coordinator_session_.request(participant_request);
+    MulticastMessageHeader header = reply.header;
     if (header.type == MulticastMessageType::ACKNOWLEDGEMENT) {        
         this->connected_ = false;
-        this->participant_receive_socket_.do_shutdown();
-        this->participant_receive_socket_.~InternetSocket();
-        std::cout << "> You are now disconnected from the multicast group" << "\n";
+        // Wait for the receiving thread to stop polling before closing the socket, since a socket
+        // that is still being polled keeps listening on its port until the poll times out
         if (incoming_messages_thread_.joinable()) {
             incoming_messages_thread_.join();
         }
+        this->participant_receive_socket_ = InternetSocket();
+        std::cout << "> You are now disconnected from the multicast group" << "\n";
         return;
     }
     else {
@@ -238,6 +299,7 @@ void Participant::handleDisconnect(MulticastMessage participant_request) {
 }
 
 void Participant::handleMSend(MulticastMessage participant_request) {
+    TRACE_SPAN("participant.msend");
     if (!this->registered_) {
         std::cout << "> You must be registered to send messages to the multicast group" << "\n";
         return;
@@ -246,23 +308,19 @@ void Participant::handleMSend(MulticastMessage participant_request) {
         std::cout << "> You must be connected to send messages to the multicast group" << "\n";
         return;
     }
-    InternetSocket participant_send_socket_;
-    participant_send_socket_.do_connect(this->remoteaddr, this->coordinator_port);
-    participant_send_socket_.do_sendall(participant_request.to_buffer());
-    Buffer header_buffer(sizeof(MulticastMessageHeader));
-    size_t bytes_recvd = participant_send_socket_.do_recv(header_buffer, MSG_PEEK);
-
-    if (bytes_recvd == 0) {
-        return;
-    }
-    participant_send_socket_.do_recvall(header_buffer);
-    MulticastMessageHeader header = MulticastMessageHeader::from_buffer(header_buffer);
-    if (header.type == MulticastMessageType::ACKNOWLEDGEMENT) {
+    if ((participant_request.header().flags & HEADER_FLAG_GROUP) && this->protocol_version_ < GROUP_VERSION) {
+        std::cout << "> The coordinator does not support named groups" << "\n";
         return;
     }
-    else {
-        std::cout << "> Message was not sent succesfully to multicast group" << "\n";
-        return;
+    if (this->compression_threshold_ > 0) participant_request.compress(this->compression_threshold_);
+    // Msends are pipelined over the session rather than waited on, so a failure is only reported
+    // once the coordinator answers. Messages too large for one frame are sent as several chunks,
+    // which the coordinator passes on as they arrive
+    for (MulticastMessage &chunk : participant_request.split(this->chunk_size_)) {
+        this->coordinator_session_.send(chunk, [](const Reply &reply) {
+            if (reply.header.type == MulticastMessageType::ACKNOWLEDGEMENT) return;
+            std::cout << "> Message was not sent succesfully to multicast group" << "\n";
+        });
     }
 }
 
@@ -271,10 +329,86 @@ void Participant::handleQuit() {
         std::cout << "> Please disconnect before quitting" << "\n";
         return;
     }
+    // Wait for every msend still in flight to be answered before leaving
+    this->coordinator_session_.close();
+    if (incoming_messages_thread_.joinable()) {
+        incoming_messages_thread_.join();
+    }
     std::cout << "> Thank you for using this persistent and asynchronous multicast" << "\n";
     this->stop();
 }
 
+void Participant::handleStats(MulticastMessage participant_request) {
+    // The coordinator answers with its metrics whether or not this participant is registered
+    Reply reply = this->coordinator_session_.request(participant_request);
+    if (reply.header.type == MulticastMessageType::ACKNOWLEDGEMENT) {
+        std::cout << "> Coordinator metrics:" << "\n" << reply.body;
+    }
+    else {
+        std::cout << "> You were not able to get the coordinator's metrics" << "\n";
+    }
+    std::cout << "> Participant metrics:" << "\n" << metrics().report();
+}
+
+void Participant::handleSubscribe(MulticastMessage participant_request) {
+    if (!this->registered_ || !this->connected_) {
+        std::cout << "> You must be registered and connected to subscribe to groups" << "\n";
+        return;
+    }
+    if (this->protocol_version_ < GROUP_VERSION) {
+        std::cout << "> The coordinator does not support named groups" << "\n";
+        return;
+    }
+    std::string name = participant_request.body();
+    uint32_t group = group_id(name);
+    {
+        std::lock_guard<std::mutex> lock(this->subscriptions_lock_);
+        if (this->subscriptions_.count(group) > 0) {
+            std::cout << "> You are already subscribed to group " << name << "\n";
+            return;
+        }
+    }
+    Reply reply = this->coordinator_session_.request(participant_request);
+    if (reply.header.type == MulticastMessageType::ACKNOWLEDGEMENT) {
+        {
+            std::lock_guard<std::mutex> lock(this->subscriptions_lock_);
+            this->subscriptions_[group] = Subscription {name, 0};
+        }
+        std::cout << "> You are now subscribed to group " << name << "\n";
+    }
+    else {
+        std::cout << "> You were not able to subscribe to group " << name << "\n";
+    }
+}
+
+void Participant::handleUnsubscribe(MulticastMessage participant_request) {
+    if (!this->registered_ || !this->connected_) {
+        std::cout << "> You must be registered and connected to unsubscribe from groups" << "\n";
+        return;
+    }
+    std::string name = participant_request.body();
+    {
+        std::lock_guard<std::mutex> lock(this->subscriptions_lock_);
+        if (this->subscriptions_.count(group_id(name)) == 0) {
+            std::cout << "> You are not subscribed to group " << name << "\n";
+            return;
+        }
+    }
+    Reply reply = this->coordinator_session_.request(participant_request);
+    if (reply.header.type == MulticastMessageType::ACKNOWLEDGEMENT) {
+        {
+            std::lock_guard<std::mutex> lock(this->subscriptions_lock_);
+            this->subscriptions_.erase(group_id(name));
+            // No more of the group's messages are logged, so the ones being gathered are dropped
+            this->discardPartialMessages(group_id(name));
+        }
+        std::cout << "> You are now unsubscribed from group " << name << "\n";
+    }
+    else {
+        std::cout << "> You were not able to unsubscribe from group " << name << "\n";
+    }
+}
+
 void Participant::handleIncomingMulticastMessages() {
     PollInfo connection_request;
     connection_request.readable  = true;
@@ -288,49 +422,141 @@ void Participant::handleIncomingMulticastMessages() {
         // We do not execute from here on forward if there is no connection from a coordinator
         InternetSocket coordinator_message_socket = participant_receive_socket_.do_accept();
 
-        // Coordinator will only seek to connect when it is about to send a message, otherwise it would not connect
-        // Get the message header
-        Buffer recv_buffer(sizeof(MulticastMessageHeader));
-        size_t bytes_recv = coordinator_message_socket.do_recv(recv_buffer, MSG_PEEK);
-
-        // Return if the socket closed (recv() returns 0)
-        if (bytes_recv == 0) continue;
-
-        coordinator_message_socket.do_recvall(recv_buffer);
+        // The coordinator keeps this connection open and sends every multicast message over it, so
+        // keep reading messages until the coordinator closes it. It only closes it after sending
+        // everything it delivered before a disconnect, so messages still in flight then are kept too
+        FrameReader message_reader(FrameReader::DEFAULT_READ_SIZE, this->max_receive_size_);
+        while (true) {
+            PollInfo message_result = coordinator_message_socket.do_poll(connection_request, 1 * 1000 /* timeout after 1 second */);
+            if (!message_result.valid) break;
+            if (!message_result.readable) {
+                if (!this->connected_) break;
+                continue;
+            }
+
+            // Stop reading from this connection if the socket closed (recv() returns 0)
+            if (!message_reader.fill(coordinator_message_socket)) break;
+
+            // Handle every message that is complete, however many arrived in the same read
+            MulticastMessageHeader header;
+            Buffer data_buffer(nullptr, 0);
+            while (message_reader.next(header, data_buffer)) {
+                // The coordinator closes the connection right after this, once everything it sent
+                // before has been read
+                if (header.type == MulticastMessageType::PARTICIPANT_EVICTED) {
+                    std::cout << "> You were disconnected from the multicast group for falling behind, reconnect to receive the messages you missed" << "\n";
+                    this->connected_ = false;
+                    continue;
+                }
+                if (header.type == MulticastMessageType::MULTI_MESSAGE_BATCH) {
+                    // Unpack every message that the coordinator coalesced into this frame
+                    MulticastBatch::unpack(data_buffer, [this](const char *frame, size_t size) {
+                        MulticastMessageHeader entry_header;
+                        size_t header_size = MulticastMessageHeader::decode((const unsigned char *)frame, size, entry_header);
+                        if (header_size == 0) return;
+                        this->logMulticastMessage(entry_header, std::string(frame + header_size, size - header_size));
+                    });
+                    continue;
+                }
+
+                this->logMulticastMessage(header, std::string((char *)data_buffer.data(), data_buffer.size()));
+            }
+            // A frame larger than any the coordinator sends would have to be held in full before it
+            // could be handled, so the connection is dropped instead of receiving it
+            if (message_reader.oversized()) {
+                std::cout << "> Dropped the connection from the coordinator, which sent a frame larger than " << this->max_receive_size_ << " bytes" << "\n";
+                break;
+            }
+        }
+    }
+}
 
-        MulticastMessageHeader header = MulticastMessageHeader::from_buffer(recv_buffer);
+void Participant::logMulticastMessage(MulticastMessageHeader header, std::string data) {
+    messages_received.add();
+    message_bytes_received.add(data.size());
+    // Every message is delivered in order, so a gap means messages were dropped or expired, and
+    // with them possibly chunks of the messages being gathered from the same stream. Each named
+    // group is numbered on its own, and messages of groups this participant has left since they
+    // were sent are not logged
+    std::string group_name;
+    // A group's partial messages are freed when it is unsubscribed from, so the group stays
+    // subscribed to until its chunk has been gathered
+    std::unique_lock<std::mutex> subscribed;
+    if (header.flags & HEADER_FLAG_GROUP) {
+        subscribed = std::unique_lock<std::mutex>(this->subscriptions_lock_);
+        auto subscription = this->subscriptions_.find(header.group);
+        if (subscription == this->subscriptions_.end()) return;
+        uint64_t &last_sequence = subscription->second.last_sequence;
+        if (last_sequence > 0 && header.sequence > last_sequence + 1) {
+            std::cout << "> Missed " << header.sequence - last_sequence - 1 << " multicast messages of group " << subscription->second.name << "\n";
+            this->discardPartialMessages(header.group);
+        }
+        last_sequence = header.sequence;
+        group_name = subscription->second.name;
+    }
+    else if (header.flags & HEADER_FLAG_SEQUENCE) {
+        if (this->last_sequence_ > 0 && header.sequence > this->last_sequence_ + 1) {
+            std::cout << "> Missed " << header.sequence - this->last_sequence_ - 1 << " multicast messages" << "\n";
+            this->discardPartialMessages(0);
+        }
+        this->last_sequence_ = header.sequence;
+    }
 
-        // Get the message data (the message that was sent over multicast)
-        Buffer data_buffer(header.size);
-        std::string data;
-        if (header.size > 0) {
-            coordinator_message_socket.do_recvall(data_buffer);
-            data = std::string((char *)data_buffer.data(), header.size);
+    // Chunks of a message are gathered until its last one arrives. Partial messages are kept across
+    // a reconnect, since the coordinator resumes right after the last chunk that was received
+    bool continuation = header.flags & HEADER_FLAG_CONTINUATION;
+    uint64_t sender = (uint64_t)header.group << 16 | header.pid;
+    std::unique_lock<std::mutex> partial_lock(this->partial_messages_lock_);
+    auto partial = this->partial_messages_.find(sender);
+    if (partial != this->partial_messages_.end() && !continuation) {
+        std::cout << "> Discarded an incomplete multicast message from Participant #" << header.pid << "\n";
+        this->partial_messages_.erase(partial);
+        partial = this->partial_messages_.end();
+    }
+    // The beginning of the message expired before it could be replayed
+    if (continuation && partial == this->partial_messages_.end()) return;
+    if (header.flags & HEADER_FLAG_MORE_CHUNKS) {
+        this->partial_messages_[sender] += data;
+        return;
+    }
+    if (continuation) {
+        data = std::move(partial->second) + data;
+        this->partial_messages_.erase(partial);
+    }
+    partial_lock.unlock();
+    if (subscribed) subscribed.unlock();
+
+    if (header.flags & HEADER_FLAG_COMPRESSED) {
+        std::string compressed = std::move(data);
+        if (!decompress_payload(compressed.data(), compressed.size(), data)) {
+            std::cout << "> Received a multicast message that could not be decompressed" << "\n";
+            return;
         }
+    }
+    std::time_t msg_time = header.coordinator_time;
+    std::tm *ptm = std::localtime(&msg_time);
+    char buffer[32];
+    std::strftime(buffer, 32, "%a, %d.%m.%Y %H:%M:%S", ptm);
+    std::string time_string(buffer);
+    std::string recvd_multi_msg = 
+        "[Multicast Message Sent from Participant #" 
+        + std::to_string(header.pid) 
+        + (group_name.empty() ? "" : " to Group " + group_name)
+        + " at "
+        + time_string
+        + "]: " 
+        + data 
+        + "\n";
+
+    // cout and log received message
+    this->message_logger_.log(std::move(recvd_multi_msg));
+}
 
-        std::stringstream time_stringstream_representation;
-        time_stringstream_representation << header.coordinator_time;
-        std::string time_string_representation = time_stringstream_representation.str();
-
-        std::time_t msg_time = header.coordinator_time;
-        std::tm *ptm = std::localtime(&msg_time);
-        char buffer[32];
-        std::strftime(buffer, 32, "%a, %d.%m.%Y %H:%M:%S", ptm);
-        std::string time_string(buffer);
-        // cout received message
-        std::string recvd_multi_msg = 
-            "[Multicast Message Sent from Participant #" 
-            + std::to_string(header.pid) 
-            + " at "
-            + time_string
-            + "]: " 
-            + data 
-            + "\n";
-        std::cout << recvd_multi_msg;
-
-        // log received message
-        std::ofstream outfile;
-        outfile.open(this->log_file_path_, std::ios_base::app);
-        outfile << recvd_multi_msg;
+void Participant::discardPartialMessages(uint32_t group) {
+    std::lock_guard<std::mutex> lock(this->partial_messages_lock_);
+    // Partial messages are keyed by their group above the pid of their sender
+    for (auto partial = this->partial_messages_.begin(); partial != this->partial_messages_.end();) {
+        if (partial->first >> 16 == group) partial = this->partial_messages_.erase(partial);
+        else partial++;
     }
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+// File: trace.cpp
+// Author(s): Caleb Johnson-Cantrell, Carlos López Ramírez, Ojas Nadkarni
+
+#include "include/trace.hpp"
+
+#ifdef MULTICAST_TRACE
+
+#include <unistd.h>
+
+#include <sstream>
+
+// Guards `trace_buffers`, `free_trace_buffers` and `trace_threads`
+static std::mutex trace_buffers_lock;
+
+// Every buffer that was ever created, of which there are only as many as threads that recorded spans
+// at the same time
+//
+// Buffers are never destroyed, so the spans of threads that have exited are still exported until
+// they are overwritten.
+static std::vector<TraceBuffer *> trace_buffers;
+
+// The buffers of threads that have exited, which the next threads to record a span take over
+static std::vector<TraceBuffer *> free_trace_buffers;
+
+// The number of threads that have recorded a span
+static uint32_t trace_threads = 0;
+
+// Hands the buffer of its thread back to `free_trace_buffers` when the thread exits
+struct TraceBufferOwner {
+    TraceBuffer *buffer = nullptr;
+
+    ~TraceBufferOwner() {
+        if (buffer == nullptr) return;
+        std::lock_guard<std::mutex> lock(trace_buffers_lock);
+        free_trace_buffers.push_back(buffer);
+    }
+};
+
+// TraceBuffer Public API Functions ----------------------------------------------------------------
+
+TraceBuffer::TraceBuffer(uint32_t thread_id) :
+    thread_id_(thread_id), head_(0), slots_(new Slot[CAPACITY]) {}
+
+void TraceBuffer::collect(std::vector<TraceEvent> &events) const {
+    uint64_t head  = head_.load(std::memory_order_acquire);
+    uint64_t first = head > CAPACITY ? head - CAPACITY : 0;
+
+    for (uint64_t index = first; index < head; index++) {
+        const Slot &slot = slots_[index % CAPACITY];
+        uint64_t before  = slot.sequence.load(std::memory_order_acquire);
+        // The owner has already moved on and is overwriting this slot with a later span
+        if (before != 2 * index + 2) continue;
+
+        TraceEvent event;
+        event.name        = slot.name.load(std::memory_order_relaxed);
+        event.start_ns    = slot.start_ns.load(std::memory_order_relaxed);
+        event.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+        event.thread_id   = slot.thread_id.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+
+        events.push_back(event);
+    }
+}
+
+// Trace Functions ---------------------------------------------------------------------------------
+
+TraceBuffer &trace_buffer() {
+    static thread_local TraceBufferOwner owner;
+    if (owner.buffer == nullptr) {
+        std::lock_guard<std::mutex> lock(trace_buffers_lock);
+        uint32_t thread_id = ++trace_threads;
+        if (free_trace_buffers.empty()) {
+            owner.buffer = new TraceBuffer(thread_id);
+            trace_buffers.push_back(owner.buffer);
+        } else {
+            owner.buffer = free_trace_buffers.back();
+            free_trace_buffers.pop_back();
+            owner.buffer->adopt(thread_id);
+        }
+    }
+
+    return *owner.buffer;
+}
+
+std::string trace_json() {
+    std::vector<TraceBuffer *> buffers;
+    {
+        std::lock_guard<std::mutex> lock(trace_buffers_lock);
+        buffers = trace_buffers;
+    }
+
+    std::ostringstream out;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    // Chrome expects microseconds, which keep their nanoseconds as decimals
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    bool first = true;
+    std::vector<TraceEvent> events;
+    for (TraceBuffer *buffer : buffers) {
+        events.clear();
+        buffer->collect(events);
+        for (const TraceEvent &event : events) {
+            if (!first) out << ",";
+            first = false;
+            out << "\n{\"name\":\"" << event.name << "\",\"cat\":\"multicast\",\"ph\":\"X\""
+                << ",\"ts\":" << event.start_ns / 1000.0 << ",\"dur\":" << event.duration_ns / 1000.0
+                << ",\"pid\":" << getpid() << ",\"tid\":" << event.thread_id << "}";
+        }
+    }
+    out << "\n]}\n";
+
+    return out.str();
+}
+
+uint64_t trace_recorded() {
+    std::lock_guard<std::mutex> lock(trace_buffers_lock);
+    uint64_t recorded = 0;
+    for (TraceBuffer *buffer : trace_buffers) recorded += buffer->recorded();
+
+    return recorded;
+}
+
+// TraceWriter Public API Functions ----------------------------------------------------------------
+
+// The spans are only exported again once more have been recorded since the last export
+TraceWriter::TraceWriter(std::string path, std::chrono::milliseconds interval) :
+    PeriodicFileWriter(path, interval,
+                       [exported = uint64_t(0)]() mutable -> std::optional<std::string> {
+                           uint64_t recorded = trace_recorded();
+                           if (recorded == exported) return std::nullopt;
+                           exported = recorded;
+
+                           return trace_json();
+                       }) {}
+
+#endif